@@ -0,0 +1,146 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
+
+// Compares the first-fit locked_pool_allocator with locked_segregated_pool_allocator,
+// locked_pool_resource with locking_memory_resource, and the interrupt_arena with both pool allocators.
+// Single-object allocation is compared against slab_allocator.
+
+#include <vector>
+#include <list>
+#include <random>
+#include <experimental/list>
+#include <jw/dpmi/alloc.h>
+#include <jw/dpmi/detail/alloc.h>
+#include "bench.h"
+
+using namespace jw;
+
+constexpr std::size_t pool_size { 1_MB };
+constexpr std::size_t iterations { 100000 };
+
+template<typename A>
+void alloc_free(const std::string& name, A alloc)
+{
+    bench::run(name + ": alloc/free, empty pool", iterations, [&](auto)
+    {
+        auto* p = alloc.allocate(64);
+        bench::keep(p);
+        alloc.deallocate(p, 64);
+    });
+}
+
+template<typename A>
+void alloc_free_filled(const std::string& name, A alloc, std::size_t live)
+{
+    std::vector<byte*> chunks;
+    for (std::size_t i = 0; i < live; ++i) chunks.push_back(alloc.allocate(32));
+
+    bench::run(name + ": alloc/free, " + std::to_string(live) + " live", iterations / 10, [&](auto)
+    {
+        auto* p = alloc.allocate(64);
+        bench::keep(p);
+        alloc.deallocate(p, 64);
+    });
+
+    for (auto* p : chunks) alloc.deallocate(p, 32);
+}
+
+template<typename A>
+void churn(const std::string& name, A alloc)
+{
+    constexpr std::size_t slots { 256 };
+    std::vector<std::pair<byte*, std::size_t>> live(slots, { nullptr, 0 });
+    std::mt19937 rng { 1234 };
+    std::uniform_int_distribution<std::size_t> slot { 0, slots - 1 };
+    std::uniform_int_distribution<std::size_t> size { 8, 512 };
+
+    bench::run(name + ": random churn", iterations, [&](auto)
+    {
+        auto& s = live[slot(rng)];
+        if (s.first != nullptr) alloc.deallocate(s.first, s.second);
+        s.second = size(rng);
+        s.first = alloc.allocate(s.second);
+    });
+
+    for (auto& s : live) if (s.first != nullptr) alloc.deallocate(s.first, s.second);
+}
+
+// Simulates an interrupt handler that makes a few short-lived allocations.
+template<typename A>
+void irq_pattern(const std::string& name, A alloc)
+{
+    std::array<byte*, 8> p;
+    bench::run(name + ": 8 allocations per irq", iterations, [&](auto)
+    {
+        for (std::size_t i = 0; i < p.size(); ++i) p[i] = alloc.allocate(16 + i * 8);
+        bench::keep(p);
+        for (std::size_t i = 0; i < p.size(); ++i) alloc.deallocate(p[i], 16 + i * 8);
+    });
+}
+
+void irq_pattern_arena()
+{
+    dpmi::detail::interrupt_arena arena { 64_KB };
+    std::array<void*, 8> p;
+    bench::run("arena: 8 allocations per irq", iterations, [&](auto)
+    {
+        auto mark = arena.mark();
+        for (std::size_t i = 0; i < p.size(); ++i) p[i] = arena.allocate(16 + i * 8);
+        bench::keep(p);
+        arena.release(mark);
+    });
+}
+
+// Allocate and free a 528-byte object, the size of an fpu_context with SSE.
+struct alignas(0x10) object { std::array<byte, 528> data; };
+
+template<typename A>
+void single_object(const std::string& name, A alloc)
+{
+    std::vector<object*> live;
+    for (std::size_t i = 0; i < 32; ++i) live.push_back(alloc.allocate(1));
+    bench::run(name + ": single object, 32 live", iterations, [&](auto)
+    {
+        auto* p = alloc.allocate(1);
+        bench::keep(p);
+        alloc.deallocate(p, 1);
+    });
+    for (auto* p : live) alloc.deallocate(p, 1);
+}
+
+void pmr_list(const std::string& name, std::experimental::pmr::memory_resource* res)
+{
+    std::experimental::pmr::list<int> list { res };
+    bench::run(name + ": pmr::list push/pop", iterations, [&](auto i)
+    {
+        list.push_back(i);
+        if (list.size() > 64) list.pop_front();
+    });
+}
+
+int main(int, char**)
+{
+    alloc_free("first-fit", dpmi::locked_pool_allocator<> { pool_size });
+    alloc_free("segregated", dpmi::locked_segregated_pool_allocator<> { pool_size });
+    for (auto n : { 100, 1000, 10000 })
+    {
+        alloc_free_filled("first-fit", dpmi::locked_pool_allocator<> { pool_size }, n);
+        alloc_free_filled("segregated", dpmi::locked_segregated_pool_allocator<> { pool_size }, n);
+    }
+    churn("first-fit", dpmi::locked_pool_allocator<> { pool_size });
+    churn("segregated", dpmi::locked_segregated_pool_allocator<> { pool_size });
+
+    irq_pattern("first-fit", dpmi::locked_pool_allocator<> { pool_size });
+    irq_pattern("segregated", dpmi::locked_segregated_pool_allocator<> { pool_size });
+    irq_pattern_arena();
+
+    single_object("first-fit", dpmi::locked_pool_allocator<object> { 64_KB });
+    single_object("segregated", dpmi::locked_segregated_pool_allocator<object> { 64_KB });
+    dpmi::slab_allocator<object>::reserve(64);
+    single_object("slab", dpmi::slab_allocator<object> { });
+
+    dpmi::locking_memory_resource locking_res { };
+    pmr_list("locking_memory_resource", &locking_res);
+    dpmi::locked_pool_resource pool_res { 64_KB };
+    pmr_list("locked_pool_resource", &pool_res);
+}
@@ -0,0 +1,47 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
+
+// Minimal benchmark harness. Each benchmark runs a function a fixed number of
+// times and reports the average time per iteration.
+// If the environment variable BENCH_OUTPUT names a file, results are also
+// appended to it as tab-separated "program, benchmark, ns/op" lines.
+
+#pragma once
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <string>
+
+namespace jw
+{
+    namespace bench
+    {
+        using clock = std::chrono::steady_clock;
+
+        // Prevent the compiler from optimizing away a value.
+        template<typename T>
+        inline void keep(T&& value) noexcept { asm volatile("" : : "g" (value) : "memory"); }
+
+        // Run func(i) for each i in [0, iterations), and print the average time per iteration.
+        template<typename F>
+        double run(const std::string& name, std::size_t iterations, F&& func)
+        {
+            auto begin = clock::now();
+            for (std::size_t i = 0; i < iterations; ++i) func(i);
+            auto end = clock::now();
+
+            auto ns = std::chrono::duration<double, std::nano> { end - begin }.count() / iterations;
+            std::cout << std::left << std::setw(48) << name << std::right << std::fixed << std::setprecision(2) << std::setw(12) << ns << " ns/op\n";
+
+            if (auto* file = std::getenv("BENCH_OUTPUT"))
+            {
+                std::ofstream out { file, std::ios::app };
+                out << program_invocation_short_name << '\t' << name << '\t' << std::fixed << std::setprecision(2) << ns << '\n';
+            }
+            return ns;
+        }
+    }
+}
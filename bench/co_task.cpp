@@ -0,0 +1,39 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
+
+// Stackless co_task coroutines, compared to the stackful task and coroutine in context_switch.cpp. This is built
+// with -std=gnu++20 (see the makefile).
+// "start and await" starts a co_task from the main thread and yields until it is done, which includes one pass
+// through the coroutine thread. The other benchmarks run 1000 steps in one co_task per iteration. With co_await,
+// each step awaits another co_task, which resumes the caller directly. With co_next_turn, each step suspends and
+// is resumed on the next pass of the coroutine thread.
+
+#include <jw/thread/co_task.h>
+#include "bench.h"
+
+using namespace jw;
+
+constexpr std::size_t iterations { 100000 };
+constexpr std::size_t steps { 1000 };
+
+thread::co_task<int> add(int a, int b) { co_return a + b; }
+
+thread::co_task<int> sum(std::size_t n)
+{
+    int x { 0 };
+    for (std::size_t i = 0; i < n; ++i) x = co_await add(x, 1);
+    co_return x;
+}
+
+thread::co_task<> next_turn(std::size_t n)
+{
+    for (std::size_t i = 0; i < n; ++i) co_await thread::co_next_turn();
+}
+
+int main(int, char**)
+{
+    bench::run("co_task: start and await", iterations, [](auto i) { bench::keep(add(i, 1).await()); });
+
+    bench::run("co_task: 1000x co_await", iterations / steps, [](auto) { bench::keep(sum(steps).await()); });
+    bench::run("co_task: 1000x co_next_turn", iterations / steps, [](auto) { next_turn(steps).await(); });
+}
@@ -0,0 +1,166 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
+
+// Cost of a complete thread switch through the scheduler, using the x86-64 variant of context_switch().
+// The yield benchmarks measure one round through the ready list, with n threads that all call yield() in a loop.
+// With one thread, the main thread switches to itself. The other benchmarks measure starting a task and awaiting
+// its result, and one yield/await round-trip with a stackful coroutine.
+// The mutex benchmark hands a lock between the main thread and n - 1 others, which are blocked in lock() while the
+// main thread holds it. The condition_variable and semaphore benchmarks measure one round-trip between two threads.
+// co_task is not included, since it needs C++20 coroutines.
+
+#include <vector>
+#include <mutex>
+#include <jw/thread/task.h>
+#include <jw/thread/coroutine.h>
+#include <jw/thread/mutex.h>
+#include <jw/thread/condition_variable.h>
+#include <jw/thread/semaphore.h>
+#include "bench.h"
+
+using namespace jw;
+
+constexpr std::size_t iterations { 1000000 };
+
+void yield_round_trip(std::size_t n)
+{
+    bool run { true };
+    std::vector<thread::task<void()>> tasks;
+    for (std::size_t i = 1; i < n; ++i)
+    {
+        tasks.emplace_back([&run]() { while (run) thread::yield(); });
+        tasks.back()->start();
+    }
+
+    bench::run("yield, " + std::to_string(n) + " threads", iterations, [](auto) { thread::yield(); });
+
+    run = false;
+    for (auto& t : tasks) t->await();
+}
+
+void task_start_await()
+{
+    int x { 0 };
+    thread::task<int()> t { [&x]() { return ++x; } };
+
+    bench::run("task: start and await", iterations, [&](auto)
+    {
+        t->start();
+        bench::keep(t->await());
+    });
+}
+
+void mutex_handoff(std::size_t n)
+{
+    bool run { true };
+    thread::mutex m { };
+    std::vector<thread::task<void()>> tasks;
+    for (std::size_t i = 1; i < n; ++i)
+    {
+        tasks.emplace_back([&]()
+        {
+            while (run)
+            {
+                m.lock();
+                m.unlock();
+                thread::yield();
+            }
+        });
+        tasks.back()->start();
+    }
+
+    bench::run("mutex: contended lock, " + std::to_string(n) + " threads", iterations / n, [&](auto)
+    {
+        m.lock();
+        thread::yield();    // other threads block in lock()
+        m.unlock();
+        thread::yield();    // one of them takes the lock
+    });
+
+    run = false;
+    for (auto& t : tasks) t->await();
+}
+
+void condition_variable_round_trip()
+{
+    bool run { true };
+    bool ping { false };
+    thread::mutex m { };
+    thread::condition_variable cv { };
+    thread::task<void()> t { [&]()
+    {
+        std::unique_lock<thread::mutex> lock { m };
+        while (true)
+        {
+            cv.wait(lock, [&] { return ping || !run; });
+            if (!run) break;
+            ping = false;
+            cv.notify_one();
+        }
+    } };
+    t->start();
+
+    bench::run("condition_variable: notify and wait", iterations, [&](auto)
+    {
+        std::unique_lock<thread::mutex> lock { m };
+        ping = true;
+        cv.notify_one();
+        cv.wait(lock, [&] { return !ping; });
+    });
+
+    {
+        std::unique_lock<thread::mutex> lock { m };
+        run = false;
+        cv.notify_one();
+    }
+    t->await();
+}
+
+void semaphore_round_trip()
+{
+    bool run { true };
+    thread::semaphore ping { }, pong { };
+    thread::task<void()> t { [&]()
+    {
+        while (true)
+        {
+            ping.acquire();
+            if (!run) break;
+            pong.release();
+        }
+    } };
+    t->start();
+
+    bench::run("semaphore: release and acquire", iterations, [&](auto)
+    {
+        ping.release();
+        pong.acquire();
+    });
+
+    run = false;
+    ping.release();
+    t->await();
+}
+
+void coroutine_round_trip()
+{
+    thread::coroutine<int()> c { [](auto& self) { for (int i = 0; ; ++i) self.yield(i); } };
+    c->start();
+
+    bench::run("coroutine: yield and await", iterations, [&](auto) { bench::keep(c->await()); });
+
+    c->abort();
+}
+
+int main(int, char**)
+{
+    yield_round_trip(1);
+    yield_round_trip(2);
+    yield_round_trip(8);
+    task_start_await();
+    mutex_handoff(2);
+    mutex_handoff(16);
+    condition_variable_round_trip();
+    semaphore_round_trip();
+    coroutine_round_trip();
+}
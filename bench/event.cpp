@@ -0,0 +1,41 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
+
+// event<> dispatch to a varying number of subscribers.
+
+#include <memory>
+#include <vector>
+#include <jw/event.h>
+#include "bench.h"
+
+using namespace jw;
+
+constexpr std::size_t iterations { 100000 };
+
+void run(std::size_t subscribers)
+{
+    int sum { 0 };
+    std::vector<std::unique_ptr<callback<void(int)>>> void_callbacks;
+    std::vector<std::unique_ptr<callback<int(int)>>> int_callbacks;
+    event<void(int)> void_event;
+    event<int(int)> int_event;
+    for (std::size_t i = 0; i < subscribers; ++i)
+    {
+        void_callbacks.emplace_back(new callback<void(int)> { [&sum](int x) { sum += x; } });
+        int_callbacks.emplace_back(new callback<int(int)> { [](int x) { return x + 1; } });
+        void_event += *void_callbacks.back();
+        int_event += *int_callbacks.back();
+    }
+
+    auto n = std::to_string(subscribers);
+    bench::run("event<void(int)>, " + n + " subscribers", iterations, [&](auto i) { void_event(i); });
+    bench::run("event<int(int)>, " + n + " subscribers", iterations, [&](auto i) { bench::keep(int_event(i).size()); });
+    bench::keep(sum);
+}
+
+int main(int, char**)
+{
+    run(1);
+    run(4);
+    run(16);
+}
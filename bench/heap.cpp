@@ -0,0 +1,79 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
+
+// Compares the size-class heap used for operator new() (config::enable_builtin_heap) with malloc().
+
+#include <cstdlib>
+#include <vector>
+#include <random>
+#include <sys/mman.h>
+#include <jw/dpmi/detail/heap.h>
+#include "bench.h"
+
+using namespace jw;
+
+// The span map only covers 32-bit addresses, so keep the heap in the low 2GB.
+struct mmap_block_source
+{
+    static void* allocate(std::size_t n)
+    {
+        constexpr std::size_t align = dpmi::detail::basic_heap<mmap_block_source>::span_size;
+        auto* p = mmap(nullptr, n + align, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+        if (p == MAP_FAILED) throw std::bad_alloc { };
+        return reinterpret_cast<void*>((reinterpret_cast<std::uintptr_t>(p) + align - 1) & -align);
+    }
+};
+
+using heap_type = dpmi::detail::basic_heap<mmap_block_source>;
+heap_type heap { 1_MB };
+
+struct heap_alloc
+{
+    static void* allocate(std::size_t n) { return heap.allocate(n); }
+    static void deallocate(void* p) { heap.deallocate(p); }
+};
+
+struct malloc_alloc
+{
+    static void* allocate(std::size_t n) { return std::malloc(n); }
+    static void deallocate(void* p) { std::free(p); }
+};
+
+constexpr std::size_t iterations { 1000000 };
+
+template<typename A>
+void run(const std::string& name)
+{
+    bench::run(name + ": alloc/free, 32 bytes", iterations, [](auto)
+    {
+        auto* p = A::allocate(32);
+        bench::keep(p);
+        A::deallocate(p);
+    });
+
+    std::vector<void*> live(1000);
+    bench::run(name + ": alloc 1000, free 1000, 16-256 bytes", iterations / 1000, [&](auto i)
+    {
+        for (std::size_t j = 0; j < live.size(); ++j) live[j] = A::allocate(16 + ((i + j) * 16) % 256);
+        for (auto* p : live) A::deallocate(p);
+    });
+
+    std::mt19937 rng { 1 };
+    std::uniform_int_distribution<std::size_t> size { 1, 4096 };
+    std::uniform_int_distribution<std::size_t> slot { 0, live.size() - 1 };
+    for (auto& p : live) p = A::allocate(size(rng));
+    bench::run(name + ": random churn, 1-4096 bytes", iterations, [&](auto)
+    {
+        auto& p = live[slot(rng)];
+        A::deallocate(p);
+        p = A::allocate(size(rng));
+        bench::keep(p);
+    });
+    for (auto* p : live) A::deallocate(p);
+}
+
+int main(int, char**)
+{
+    run<malloc_alloc>("malloc");
+    run<heap_alloc>("builtin heap");
+}
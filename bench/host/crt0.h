@@ -0,0 +1,13 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
+
+// Host stand-in for djgpp's <crt0.h>.
+
+#pragma once
+
+#define _CRT0_FLAG_NMI_SIGNAL           0x0001
+#define _CRT0_DISABLE_SBRK_ADDRESS_WRAP 0x0002
+#define _CRT0_FLAG_NONMOVE_SBRK         0x0004
+#define _CRT0_FLAG_LOCK_MEMORY          0x0008
+
+extern int _crt0_startup_flags;
@@ -0,0 +1,25 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
+
+// Host stand-in for <jw/chrono/chrono.h>. There is no PIT or RTC, so the TSC is never calibrated.
+
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <x86intrin.h>
+
+namespace jw
+{
+    namespace chrono
+    {
+        inline std::uint64_t rdtsc() noexcept { return __rdtsc(); }
+
+        struct chrono
+        {
+            static double ns_per_tsc_tick() noexcept { return 0; }
+        };
+
+        using tsc = std::chrono::high_resolution_clock;
+        using pit = std::chrono::steady_clock;
+    }
+}
@@ -0,0 +1,20 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
+
+// Host stand-in for <jw/dpmi/debug.h>.
+
+#pragma once
+
+namespace jw
+{
+    namespace dpmi
+    {
+        constexpr inline bool debug() noexcept { return false; }
+        inline void breakpoint() { }
+
+        struct trap_mask
+        {
+            constexpr trap_mask() noexcept { }
+        };
+    }
+}
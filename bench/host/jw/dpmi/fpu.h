@@ -0,0 +1,26 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
+
+// Host stand-in for <jw/dpmi/fpu.h>. SSE registers are caller-saved in the x86-64 ABI, so there is nothing to
+// switch between threads.
+
+#pragma once
+
+namespace jw
+{
+    namespace dpmi
+    {
+        class fpu_context;
+
+        namespace detail
+        {
+            struct fpu_context_switcher_t
+            {
+                void prepare_switch(fpu_context**) { }
+                void switch_thread(fpu_context**, fpu_context**) noexcept { }
+                void release_thread(fpu_context**) noexcept { }
+            };
+            inline fpu_context_switcher_t fpu_context_switcher;
+        }
+    }
+}
@@ -0,0 +1,26 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
+
+// Host stand-in for <jw/dpmi/irq_mask.h>. There are no interrupts to mask on the host.
+
+#pragma once
+
+namespace jw
+{
+    namespace dpmi
+    {
+        class interrupt_mask
+        {
+        public:
+            interrupt_mask() noexcept { }
+            ~interrupt_mask() noexcept { }
+
+            interrupt_mask(const interrupt_mask&) = delete;
+            interrupt_mask(interrupt_mask&&) = delete;
+            interrupt_mask& operator=(const interrupt_mask&) = delete;
+            interrupt_mask& operator=(interrupt_mask&&) = delete;
+
+            static bool get() noexcept { return true; }
+        };
+    }
+}
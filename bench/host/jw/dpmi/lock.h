@@ -0,0 +1,30 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
+
+// Host stand-in for <jw/dpmi/lock.h>. Memory is never paged out on the host, so locks are no-ops.
+
+#pragma once
+#include <cstddef>
+
+namespace jw
+{
+    namespace dpmi
+    {
+        namespace detail
+        {
+            struct page_lock_table
+            {
+                static void lock(const void*, std::size_t) noexcept { }
+                static void unlock(const void*, std::size_t) noexcept { }
+            };
+        }
+
+        struct data_lock final
+        {
+            data_lock(const void*, std::size_t = 1) noexcept { }
+        };
+
+        template <typename T>
+        struct class_lock { };
+    }
+}
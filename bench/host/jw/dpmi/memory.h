@@ -0,0 +1,38 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
+
+// Host stand-in for <jw/dpmi/memory.h>. There is no DPMI host to commit pages with, so guard pages are never
+// available, and the scheduler falls back to plain stacks.
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+namespace jw
+{
+    namespace dpmi
+    {
+        struct dpmi_error : public std::runtime_error
+        {
+            dpmi_error() : std::runtime_error("DPMI function not available on the host.") { }
+        };
+
+        inline std::size_t get_page_size() { return 4096; }
+
+        struct linear_memory
+        {
+            linear_memory(std::uintptr_t, std::size_t) noexcept { }
+            void lock_memory() { }
+            void unlock_memory() { }
+        };
+
+        struct memory_base
+        {
+            memory_base(std::size_t) noexcept { }
+            std::uintptr_t get_address() const noexcept { return 0; }
+            template<typename T> T* get_ptr() const noexcept { return nullptr; }
+            void commit(std::size_t, std::size_t, bool) { throw dpmi_error { }; }
+        };
+    }
+}
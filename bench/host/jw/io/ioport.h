@@ -0,0 +1,59 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
+
+// Host stand-in for <jw/io/ioport.h>. Ports are backed by an array, so values written to a port can be read back.
+
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <jw/common.h>
+
+namespace jw
+{
+    namespace io
+    {
+        using port_num = std::uint_fast16_t;
+        namespace detail
+        {
+            inline std::array<byte, 0x10003> port_space { };
+
+            template <typename T> inline void out(port_num p, T v) noexcept { std::memcpy(&port_space[p], &v, sizeof(T)); }
+            template <typename T> inline T in(port_num p) noexcept { T v; std::memcpy(&v, &port_space[p], sizeof(T)); return v; }
+        }
+
+        template <typename T = byte>
+        struct out_port
+        {
+            void write(T value) const { detail::out<T>(p, value); }
+            auto& operator=(auto value) const { write(value); return *this; }
+            void operator()(T value) const { return write(value); }
+
+            constexpr out_port(auto _p) noexcept : p(_p) { }
+            out_port(const out_port&) = delete;
+            out_port& operator=(const out_port&) = delete;
+        private:
+            const port_num p;
+        };
+
+        template <typename T = byte>
+        struct in_port
+        {
+            auto read() const { return detail::in<T>(p); }
+            operator T() const { return read(); }
+            T operator()() const { return read(); }
+
+            constexpr in_port(auto _p) noexcept : p(_p) { }
+            in_port(const in_port&) = delete;
+            in_port& operator=(const in_port&) = delete;
+        private:
+            const port_num p;
+        };
+
+        template <typename T = byte>
+        struct io_port final : public in_port<T>, public out_port<T>
+        {
+            constexpr io_port(auto _p) noexcept : in_port<T>(_p), out_port<T>(_p) { }
+        };
+    }
+}
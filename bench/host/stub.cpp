@@ -0,0 +1,19 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
+
+// Definitions for the host stand-in headers.
+
+#include <jw/dpmi/irq_check.h>
+
+namespace jw
+{
+    namespace dpmi
+    {
+        namespace detail
+        {
+            volatile std::uint32_t interrupt_count { 0 };
+            volatile std::uint32_t exception_count { 0 };
+            volatile std::uint64_t interrupt_cycles { 0 };
+        }
+    }
+}
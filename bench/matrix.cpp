@@ -0,0 +1,43 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
+
+// matrix_range fill() and assign() on a 320x200 frame buffer.
+
+#include <jw/matrix.h>
+#include <jw/video/pixel.h>
+#include "bench.h"
+
+using namespace jw;
+using namespace jw::video;
+
+constexpr std::size_t iterations { 1000 };
+
+template<typename T>
+void run(const std::string& name, const T& value)
+{
+    matrix_container<T> screen { 320, 200 };
+    matrix_container<T> sprite { 64, 64 };
+    sprite.fill(value);
+
+    bench::run(name + ": fill 320x200", iterations, [&](auto)
+    {
+        screen.fill(value);
+        bench::keep(&screen(0, 0));
+    });
+    bench::run(name + ": fill 64x64 range", iterations, [&](auto i)
+    {
+        screen.range({ static_cast<int>(i % 256), 100 }, { 64, 64 }).fill(value);
+        bench::keep(&screen(0, 0));
+    });
+    bench::run(name + ": assign 64x64 range", iterations, [&](auto i)
+    {
+        screen.range({ static_cast<int>(i % 256), 100 }, { 64, 64 }).assign(sprite);
+        bench::keep(&screen(0, 0));
+    });
+}
+
+int main(int, char**)
+{
+    run<byte>("byte", 0x42);
+    run<px32n>("px32n", px32n { 0x40, 0x80, 0xc0 });
+}
@@ -0,0 +1,51 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
+
+// Pixel format conversion and alpha blending.
+
+#include <new>
+#include <vector>
+#include <jw/video/pixel.h>
+#include "bench.h"
+
+using namespace jw;
+using namespace jw::video;
+
+constexpr std::size_t pixels { 64000 };
+constexpr std::size_t iterations { 100 };
+
+template<typename D, typename S>
+void cast(const std::string& name)
+{
+    std::vector<pixel<S>> src(pixels, pixel<S> { 0x40, 0x80, 0xc0, 0x80 });
+    std::vector<pixel<D>> dst(pixels);
+    bench::run("cast " + name, iterations, [&](auto)
+    {
+        // pixel::operator= blends, so construct in place to measure the conversion alone.
+        for (std::size_t i = 0; i < pixels; ++i) new (&dst[i]) pixel<D> { src[i].template cast_to<D>() };
+        bench::keep(dst.data());
+    });
+}
+
+template<typename D, typename S>
+void blend(const std::string& name)
+{
+    std::vector<S> src(pixels, S { 0x40, 0x80, 0xc0, 0x80 });
+    std::vector<D> dst(pixels, D { 0x10, 0x10, 0x10 });
+    bench::run("blend " + name, iterations, [&](auto)
+    {
+        for (std::size_t i = 0; i < pixels; ++i) dst[i].blend(src[i]);
+        bench::keep(dst.data());
+    });
+}
+
+int main(int, char**)
+{
+    std::cout << "per " << pixels << " pixels:\n";
+    cast<bgr_5650, bgra_8888>("px32a -> px16");
+    cast<bgra_ffff, bgra_8888>("px32a -> pxf");
+    cast<bgra_8888, bgra_ffff>("pxf -> px32a");
+    blend<px32a, px32a>("px32a over px32a");
+    blend<px16, px32a>("px32a over px16");
+    blend<pxf, pxf>("pxf over pxf");
+}
@@ -0,0 +1,42 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
+
+// Scancode extraction and decoding, as done by the keyboard driver for each received byte sequence.
+
+#include <deque>
+#include <vector>
+#include <jw/io/detail/scancode.h>
+#include "bench.h"
+
+using namespace jw;
+using namespace jw::io;
+using namespace jw::io::detail;
+
+constexpr std::size_t iterations { 100000 };
+
+// Press and release 'a', left shift, right ctrl (extended) and pause (E1 prefix).
+const std::vector<raw_scancode> set2_input { 0x1c, 0xf0, 0x1c, 0x12, 0xf0, 0x12, 0xe0, 0x14, 0xe0, 0xf0, 0x14, 0xe1, 0x14, 0x77 };
+const std::vector<raw_scancode> set3_input { 0x1c, 0xf0, 0x1c, 0x12, 0xf0, 0x12, 0x58, 0xf0, 0x58 };
+
+void run(const std::string& name, const std::vector<raw_scancode>& input, scancode_set set)
+{
+    bench::run(name + ": extract", iterations, [&](auto)
+    {
+        std::deque<raw_scancode> codes { input.begin(), input.end() };
+        auto seq = scancode::extract(codes, set);
+        bench::keep(seq.size());
+    });
+
+    std::deque<raw_scancode> codes { input.begin(), input.end() };
+    auto seq = scancode::extract(codes, set);
+    bench::run(name + ": decode " + std::to_string(seq.size()) + " sequences", iterations, [&](auto)
+    {
+        for (auto& s : seq) bench::keep(s.decode());
+    });
+}
+
+int main(int, char**)
+{
+    run("set 2", set2_input, set2);
+    run("set 3", set3_input, set3);
+}
@@ -0,0 +1,137 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
+
+// Cost of selecting the next thread on yield(), with the intrusive ready list used by the scheduler, compared to
+// the previous std::deque<thread_ptr> queue. The context switch itself is not included, see context_switch.cpp.
+// The priority variant spreads threads over all levels, and includes finding the highest non-empty level.
+// The task benchmarks compare creating a task with an embedded 64KB stack, to one that takes its stack from a
+// free list, as the scheduler's stack pool does.
+
+#include <array>
+#include <deque>
+#include <vector>
+#include <jw/thread/detail/scheduler.h>
+#include <jw/dpmi/alloc.h>
+#include "bench.h"
+
+using namespace jw;
+using namespace jw::thread::detail;
+
+struct bench_thread : thread
+{
+    bench_thread() : thread(0) { state = running; }
+};
+
+constexpr std::size_t iterations { 1000000 };
+
+void deque_queue(std::size_t n)
+{
+    dpmi::locked_pool_allocator<> alloc { 128_KB };
+    std::deque<thread_ptr, dpmi::locked_pool_allocator<>> threads { alloc };
+    for (std::size_t i = 1; i < n; ++i) threads.push_back(std::make_shared<bench_thread>());
+    thread_ptr current = std::make_shared<bench_thread>();
+
+    bench::run("deque<thread_ptr>: yield, " + std::to_string(n) + " threads", iterations, [&](auto)
+    {
+        dpmi::interrupt_mask no_interrupts_please { };
+        do
+        {
+            if (current->is_running()) threads.push_back(current);
+            current = threads.front();
+            threads.pop_front();
+        } while (current->get_state() == suspended);
+        bench::keep(current.get());
+    });
+}
+
+void intrusive_queue(std::size_t n)
+{
+    std::vector<thread_ptr> owners;
+    thread_list ready;
+    for (std::size_t i = 1; i < n; ++i)
+    {
+        owners.push_back(std::make_shared<bench_thread>());
+        ready.push_back(owners.back().get());
+    }
+    owners.push_back(std::make_shared<bench_thread>());
+    jw::thread::detail::thread* current = owners.back().get();
+
+    bench::run("thread_list: yield, " + std::to_string(n) + " threads", iterations, [&](auto)
+    {
+        dpmi::interrupt_mask no_interrupts_please { };
+        ready.push_back(current);
+        current = ready.pop_front();
+        bench::keep(current);
+    });
+}
+
+void priority_queue(std::size_t n)
+{
+    std::vector<thread_ptr> owners;
+    std::array<thread_list, jw::thread::detail::thread::max_priority + 1> ready;
+    std::uint32_t mask { 0 };
+    auto push = [&](auto* t, std::uint32_t p) { ready[p].push_back(t); mask |= 1 << p; };
+    for (std::size_t i = 1; i < n; ++i)
+    {
+        owners.push_back(std::make_shared<bench_thread>());
+        push(owners.back().get(), i % jw::thread::detail::thread::max_priority);
+    }
+    owners.push_back(std::make_shared<bench_thread>());
+    jw::thread::detail::thread* current = owners.back().get();
+
+    bench::run("thread_list[" + std::to_string(ready.size()) + "]: yield, " + std::to_string(n) + " threads", iterations, [&](auto)
+    {
+        dpmi::interrupt_mask no_interrupts_please { };
+        push(current, jw::thread::detail::thread::max_priority);
+        auto level = 31 - __builtin_clz(mask);
+        current = ready[level].pop_front();
+        if (ready[level].empty()) mask &= ~(1 << level);
+        bench::keep(current);
+    });
+}
+
+struct embedded_stack_thread : bench_thread
+{
+    embedded_stack_thread() { }     // like task_base, doesn't zero the stack
+    alignas(0x10) std::array<byte, 64_KB> stack;
+};
+
+void task_creation()
+{
+    bench::run("task: embedded 64KB stack", iterations / 16, [](auto)
+    {
+        auto t = std::make_shared<embedded_stack_thread>();
+        bench::keep(t.get());
+    });
+
+    byte* free_stacks { nullptr };
+    std::vector<byte, dpmi::locking_allocator<byte>> storage(64_KB);
+    free_stacks = storage.data();
+    *reinterpret_cast<byte**>(free_stacks) = nullptr;
+    bench::run("task: pooled 64KB stack", iterations / 16, [&](auto)
+    {
+        auto t = std::make_shared<bench_thread>();
+        byte* stack;
+        {
+            dpmi::interrupt_mask no_interrupts_please { };
+            stack = free_stacks;
+            free_stacks = *reinterpret_cast<byte**>(stack);
+        }
+        bench::keep(t.get());
+        bench::keep(stack);
+        dpmi::interrupt_mask no_interrupts_please { };
+        *reinterpret_cast<byte**>(stack) = free_stacks;
+        free_stacks = stack;
+    });
+}
+
+int main(int, char**)
+{
+    for (auto n : { 2, 16, 256 })
+    {
+        deque_queue(n);
+        intrusive_queue(n);
+        priority_queue(n);
+    }
+    task_creation();
+}
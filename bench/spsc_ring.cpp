@@ -0,0 +1,46 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
+
+// Handing bytes from an interrupt handler to a thread: a std::deque on a locked pool, which the ps/2 driver used
+// before, against spsc_ring. Each iteration pushes a burst of bytes one at a time, then drains them all.
+
+#include <deque>
+#include <vector>
+#include <jw/dpmi/alloc.h>
+#include <jw/spsc_ring.h>
+#include "bench.h"
+
+using namespace jw;
+
+constexpr std::size_t iterations { 100000 };
+
+void run(std::size_t burst)
+{
+    auto n = std::to_string(burst);
+    std::vector<byte> out(burst);
+
+    dpmi::locked_pool_allocator<> alloc { 1_KB };
+    std::deque<byte, dpmi::locked_pool_allocator<>> queue { alloc };
+    bench::run("deque, burst of " + n, iterations, [&](auto i)
+    {
+        for (std::size_t j = 0; j < burst; ++j) queue.push_back(i + j);
+        std::copy(queue.begin(), queue.end(), out.begin());
+        queue.clear();
+        bench::keep(out[0]);
+    });
+
+    spsc_ring<byte, 256> ring;
+    bench::run("spsc_ring, burst of " + n, iterations, [&](auto i)
+    {
+        for (std::size_t j = 0; j < burst; ++j) ring.push_back(i + j);
+        ring.read(out.data(), burst);
+        bench::keep(out[0]);
+    });
+}
+
+int main(int, char**)
+{
+    run(1);
+    run(8);
+    run(64);
+}
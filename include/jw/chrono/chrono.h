@@ -36,6 +36,19 @@ namespace jw
             static void setup_rtc(bool enable, std::uint8_t freq_shift = 10);           // default: 64Hz
             static void setup_tsc(std::size_t num_samples, tsc_reference ref = tsc_reference::none);
 
+            // Returns the duration of one TSC cycle, or zero if the TSC has not been calibrated yet.
+            static double ns_per_tsc_tick() noexcept
+            {
+                std::uint32_t tsc_per_irq = tsc_ticks_per_irq;
+                if (tsc_per_irq == 0) return 0;
+                switch (current_tsc_ref())
+                {
+                case tsc_reference::rtc: return ns_per_rtc_tick / tsc_per_irq;
+                case tsc_reference::pit: return ns_per_pit_tick / tsc_per_irq;
+                default: return 0;
+                }
+            }
+
         private:
             static std::atomic<std::uint32_t> tsc_ticks_per_irq;
             static double ns_per_pit_tick;
@@ -5,7 +5,11 @@
 #pragma once
 #include <memory>
 #include <vector>
+#include <array>
 #include <map>
+#include <limits>
+#include <cassert>
+#include <iosfwd>
 #include <experimental/memory_resource>
 
 #include <jw/common.h>
@@ -13,25 +17,106 @@
 #include <jw/dpmi/debug.h>
 #include <jw/dpmi/irq_mask.h>
 #include <jw/dpmi/irq_check.h>
+#include <../jwdpmi_config.h>
 
 namespace jw
 {
     namespace dpmi
     {
+        // Allocator usage statistics. Only collected if config::enable_allocator_statistics is set.
+        struct allocator_statistics
+        {
+            std::size_t bytes_in_use { 0 };
+            std::size_t peak_bytes_in_use { 0 };
+            std::size_t largest_free_chunk { 0 };   // 0 if unknown
+            std::size_t allocations { 0 };          // total number of successful allocations
+            std::size_t failed_allocations { 0 };
+            std::array<std::size_t, 16> size_histogram { };  // [0]: up to 16 bytes, [i]: up to (16 << i) bytes, last: anything larger
+
+            void allocated(std::size_t n) noexcept
+            {
+                bytes_in_use += n;
+                peak_bytes_in_use = std::max(peak_bytes_in_use, bytes_in_use);
+                ++allocations;
+                ++size_histogram[bucket(n)];
+            }
+
+            void deallocated(std::size_t n) noexcept { bytes_in_use -= n; }
+            void failed() noexcept { ++failed_allocations; }
+
+        private:
+            static std::size_t bucket(std::size_t n) noexcept
+            {
+                if (n <= 16) return 0;
+                std::size_t i = std::numeric_limits<unsigned long>::digits - __builtin_clzl(n - 1) - 4;
+                return std::min(i, std::tuple_size<decltype(size_histogram)>::value - 1);
+            }
+        };
+
+        std::ostream& operator<<(std::ostream&, const allocator_statistics&);
+
+        // Print statistics for all allocators that collect them.
+        void print_allocator_statistics(std::ostream&);
+
         namespace detail
         {
-            class locking_allocator_base
+            // Named statistics object. When statistics are enabled, all of these are linked in a list, which is
+            // printed by print_allocator_statistics() and the "monitor alloc" command in gdb.
+            struct allocator_statistics_node
             {
+                allocator_statistics_node(const char* n) noexcept : name(n) { link(); }
+                allocator_statistics_node(const allocator_statistics_node&) = delete;
+                allocator_statistics_node& operator=(const allocator_statistics_node&) = delete;
+                virtual ~allocator_statistics_node() { unlink(); }
+
+                allocator_statistics get_statistics() const noexcept
+                {
+                    interrupt_mask no_interrupts_please { };
+                    auto s = stats;
+                    s.largest_free_chunk = largest_free_chunk();
+                    return s;
+                }
+
+                const char* name;
+                allocator_statistics stats { };
+
             protected:
-                static std::map<void*, data_lock>* map;
+                virtual std::size_t largest_free_chunk() const noexcept { return 0; }
+
+            private:
+                friend void dpmi::print_allocator_statistics(std::ostream&);
+
+                void link() noexcept
+                {
+                    if (!config::enable_allocator_statistics) return;
+                    interrupt_mask no_interrupts_please { };
+                    next = list;
+                    if (next != nullptr) next->prev = this;
+                    list = this;
+                }
+
+                void unlink() noexcept
+                {
+                    if (!config::enable_allocator_statistics) return;
+                    interrupt_mask no_interrupts_please { };
+                    if (prev != nullptr) prev->next = next;
+                    else list = next;
+                    if (next != nullptr) next->prev = prev;
+                }
+
+                allocator_statistics_node* next { nullptr };
+                allocator_statistics_node* prev { nullptr };
+                static allocator_statistics_node* list;
             };
+
+            allocator_statistics_node& locking_allocator_statistics();
         }
 
         // Custom allocator which locks all memory it allocates. This makes STL containers safe to
         // access from interrupt handlers, as long as the handler itself does not allocate anything.
         // It still relies on _CRT0_FLAG_LOCK_MEMORY to lock code and static data, however.
         template <typename T = byte>
-        struct locking_allocator : public detail::locking_allocator_base
+        struct locking_allocator
         {
             using value_type = T;
             using pointer = T*;
@@ -39,23 +124,48 @@ namespace jw
             auto allocate(std::size_t n)
             {
                 throw_if_irq();
-                if (__builtin_expect(map == nullptr, false)) map = new std::map<void*, data_lock> { };
                 n *= sizeof(T);
-                auto* p = ::operator new(n);
-                map->emplace(p, data_lock { p, n });
+                void* p;
+                try
+                {
+                    p = ::operator new(n);
+                    try { detail::page_lock_table::lock(p, n); }
+                    catch (...)
+                    {
+                        ::operator delete(p);
+                        throw;
+                    }
+                }
+                catch (...)
+                {
+                    if (config::enable_allocator_statistics) detail::locking_allocator_statistics().stats.failed();
+                    throw;
+                }
+                if (config::enable_allocator_statistics)
+                {
+                    interrupt_mask no_interrupts_please { };
+                    detail::locking_allocator_statistics().stats.allocated(n);
+                }
                 return static_cast<pointer>(p);
             }
 
-            void deallocate(pointer p, std::size_t)
+            void deallocate(pointer p, std::size_t n)
             {
-                map->erase(p);
+                detail::page_lock_table::unlock(p, n * sizeof(T));
                 ::operator delete(p);
+                if (config::enable_allocator_statistics)
+                {
+                    interrupt_mask no_interrupts_please { };
+                    detail::locking_allocator_statistics().stats.deallocated(n * sizeof(T));
+                }
             }
 
+            static allocator_statistics get_statistics() noexcept { return detail::locking_allocator_statistics().get_statistics(); }
+
             std::size_t max_size() const noexcept 
             { 
                 if (in_irq_context()) return 0;
-                return std::allocator<T>{ }.max_size(); 
+                return std::allocator_traits<std::allocator<T>>::max_size(std::allocator<T> { });
             }
 
             template <typename U> struct rebind { using other = locking_allocator<U>; };
@@ -63,19 +173,34 @@ namespace jw
             template <typename U>
             constexpr locking_allocator(const locking_allocator<U>&) noexcept { }
             constexpr locking_allocator() { };
-            ~locking_allocator()
-            {
-                if (map == nullptr) return;
-                if (__builtin_expect(!map->empty(), true)) return;
-                delete map;
-                map = nullptr;
-            }
 
             template <typename U> constexpr friend bool operator== (const locking_allocator&, const locking_allocator<U>&) noexcept { return true; }
             template <typename U> constexpr friend bool operator!= (const locking_allocator& a, const locking_allocator<U>& b) noexcept { return !(a == b); }
         };
 
 
+        namespace detail
+        {
+            // Statistics for locked_pool_allocator, shared by all rebound copies.
+            struct pool_statistics_node : allocator_statistics_node
+            {
+                using pool_type = std::vector<byte, locking_allocator<>>;
+
+                pool_statistics_node(const char* name, const std::shared_ptr<pool_type>& p, std::size_t(*f)(const pool_type&)) noexcept
+                    : allocator_statistics_node(name), pool(p), largest_chunk(f) { }
+
+            protected:
+                virtual std::size_t largest_free_chunk() const noexcept override
+                {
+                    auto p = pool.lock();
+                    return p ? largest_chunk(*p) : 0;
+                }
+
+                std::weak_ptr<pool_type> pool;
+                std::size_t(*largest_chunk)(const pool_type&);
+            };
+        }
+
         // Allocates from a pre-allocated locked memory pool. This allows interrupt handlers to insert/remove elements in 
         // STL containers without risking page faults.
         // When specifying a pool size, make sure to account for overhead (reallocation, fragmentation, alignment overhead). 
@@ -114,14 +239,17 @@ namespace jw
                         auto* j = aligned_ptr<pool_node>(i->begin() + n);
                         j = new(j) pool_node { i->next, true };
                         i = new(i) pool_node { j, false };
+                        if (config::enable_allocator_statistics) stats->stats.allocated(chunk_size(i));
                         return aligned_ptr<T>(i->begin());
                     }
                     else if (chunk_size(i) >= n)                                            // Use entire chunk
                     {
                         i->free = false;
+                        if (config::enable_allocator_statistics) stats->stats.allocated(chunk_size(i));
                         return aligned_ptr<T>(i->begin());
                     }
                 }
+                if (config::enable_allocator_statistics) stats->stats.failed();
                 throw std::bad_alloc { };
             }
 
@@ -135,6 +263,7 @@ namespace jw
                     if (aligned_ptr<T>(i->begin()) == p)
                     {
                         i->free = true;
+                        if (config::enable_allocator_statistics) stats->stats.deallocated(chunk_size(i));
                         return;
                     }
                 }
@@ -161,20 +290,17 @@ namespace jw
             // Returns maximum number of elements that can be allocated at once.
             auto max_size() const noexcept
             {
-                interrupt_mask no_interrupts_please { };
-                dpmi::trap_mask dont_trap_here { };
-
-                std::size_t n { 0 };
-                for (auto* i = begin(); i != nullptr; i = i->next)
-                {
-                    if (!i->free) continue;
-                    while (i->next != nullptr && i->next->free) i->next = i->next->next;
-
-                    n = std::max(n, chunk_size(i));
-                }
+                auto n = largest_chunk(*pool);
                 return n < alignof(T) ? 0 : (n - alignof(T)) / sizeof(T);
             }
 
+            // Returns usage statistics for this memory pool.
+            allocator_statistics get_statistics() const noexcept
+            {
+                if (!config::enable_allocator_statistics) return { };
+                return stats->get_statistics();
+            }
+
             bool in_pool(auto* ptr)
             {
                 auto p = reinterpret_cast<byte*>(ptr);
@@ -186,32 +312,52 @@ namespace jw
             locked_pool_allocator(const locked_pool_allocator&) = default;
             locked_pool_allocator& operator=(const locked_pool_allocator&) = default;
 
-            locked_pool_allocator(std::size_t size_bytes)
+            locked_pool_allocator(std::size_t size_bytes, const char* name = "locked_pool_allocator")
                 : pool(std::allocate_shared<pool_type>(locking_allocator<> { }, size_bytes + sizeof(pool_node), locking_allocator<> { }))
             {
                 new(begin()) pool_node { };
+                if (config::enable_allocator_statistics) stats = std::allocate_shared<detail::pool_statistics_node>(locking_allocator<> { }, name, pool, largest_chunk);
             }
 
             template <typename U> friend class locked_pool_allocator;
-            template <typename U> locked_pool_allocator(const locked_pool_allocator<U>& c) : pool(c.pool) { }
+            template <typename U> locked_pool_allocator(const locked_pool_allocator<U>& c) : pool(c.pool), stats(c.stats) { }
 
             template <typename U> struct rebind { using other = locked_pool_allocator<U>; };
             template <typename U> constexpr friend bool operator== (const locked_pool_allocator& a, const locked_pool_allocator<U>& b) noexcept { return a.pool == b.pool; }
             template <typename U> constexpr friend bool operator!= (const locked_pool_allocator& a, const locked_pool_allocator<U>& b) noexcept { return !(a == b); }
 
         protected:
-            constexpr auto* begin() const noexcept { return aligned_ptr<pool_node>(pool->data()); }
+            constexpr auto* begin() const noexcept { return begin(*pool); }
+            static constexpr auto* begin(const pool_type& pool) noexcept { return aligned_ptr<pool_node>(const_cast<byte*>(pool.data())); }
 
             // Returns size in bytes.
-            std::size_t chunk_size(pool_node* p) const noexcept
+            std::size_t chunk_size(pool_node* p) const noexcept { return chunk_size(*pool, p); }
+            static std::size_t chunk_size(const pool_type& pool, pool_node* p) noexcept
             {
-                auto end = p->next == nullptr ? pool->data() + pool->size() : reinterpret_cast<byte*>(p->next);
+                auto end = p->next == nullptr ? pool.data() + pool.size() : reinterpret_cast<byte*>(p->next);
                 return end - p->begin();
             }
 
+            // Returns size of the largest free chunk in bytes.
+            static std::size_t largest_chunk(const pool_type& pool) noexcept
+            {
+                interrupt_mask no_interrupts_please { };
+                dpmi::trap_mask dont_trap_here { };
+
+                std::size_t n { 0 };
+                for (auto* i = begin(pool); i != nullptr; i = i->next)
+                {
+                    if (!i->free) continue;
+                    while (i->next != nullptr && i->next->free) i->next = i->next->next;
+
+                    n = std::max(n, chunk_size(pool, i));
+                }
+                return n;
+            }
+
             // Align pointer to alignof(U), rounding upwards.
             template<typename U>
-            constexpr auto* aligned_ptr(byte* p) const noexcept
+            static constexpr auto* aligned_ptr(byte* p) noexcept
             {
                 auto a = reinterpret_cast<std::uintptr_t>(p);
                 auto b = a & -alignof(U);
@@ -220,32 +366,451 @@ namespace jw
             }
 
             std::shared_ptr<pool_type> pool;
+            std::shared_ptr<detail::pool_statistics_node> stats;
         };
 
-        class locking_memory_resource : public std::experimental::pmr::memory_resource
+        namespace detail
         {
-            virtual ~locking_memory_resource()
+            // Segregated-fit memory pool, operating on an externally owned block of memory.
+            // Chunks are carved in power-of-two size classes, and each size class has its own intrusive free list.
+            // A header in front of each allocation points back to the start of its chunk, so allocate() and
+            // deallocate() both run in constant time, no matter how many chunks are in use.
+            // Free chunks are never merged. When a size class runs dry, a larger chunk is split in halves.
+            class segregated_pool
             {
-                if (!map->empty()) return;
-                delete map;
-                map = nullptr;
+            public:
+                static constexpr std::size_t min_size_class { 4 };  // 16 bytes
+                static constexpr std::size_t num_size_classes { std::numeric_limits<std::size_t>::digits };
+
+                segregated_pool(byte* begin, std::size_t size_bytes) noexcept { reset(begin, size_bytes); }
+
+                segregated_pool(const segregated_pool&) = delete;
+                segregated_pool& operator=(const segregated_pool&) = delete;
+
+                void* allocate(std::size_t n, std::size_t align)
+                {
+                    auto* p = try_allocate(n, align);
+                    if (__builtin_expect(p == nullptr, false)) throw std::bad_alloc { };
+                    return p;
+                }
+
+                // Same as allocate(), but returns nullptr on failure.
+                void* try_allocate(std::size_t n, std::size_t align) noexcept
+                {
+                    interrupt_mask no_interrupts_please { };
+
+                    if (align < alignof(chunk_header)) align = alignof(chunk_header);
+                    auto max_chunk = chunk_size(num_size_classes - 1);
+                    auto overhead = sizeof(chunk_header) + align - alignof(chunk_header);
+                    if (__builtin_expect(overhead > max_chunk || n > max_chunk - overhead, false)) return nullptr;
+                    auto c = size_class(n + overhead);
+
+                    byte* chunk = pop(c);
+                    if (chunk == nullptr) chunk = carve(c);
+                    if (chunk == nullptr) chunk = split(c);
+                    if (__builtin_expect(chunk == nullptr, false)) return nullptr;
+
+                    auto* p = aligned_ptr(chunk + sizeof(chunk_header), align);
+                    auto* h = reinterpret_cast<chunk_header*>(p) - 1;
+                    h->chunk = chunk;
+                    h->size_class = c;
+                    ++in_use;
+                    return p;
+                }
+
+                void deallocate(void* p) noexcept
+                {
+                    interrupt_mask no_interrupts_please { };
+
+                    auto* h = reinterpret_cast<chunk_header*>(p) - 1;
+                    push(h->size_class, h->chunk);
+                    --in_use;
+                }
+
+                // Returns the size of the largest allocation (in bytes) that would currently succeed.
+                std::size_t max_size() const noexcept
+                {
+                    std::size_t n { 0 };
+                    if (free_classes != 0) n = chunk_size(last_bit(free_classes));
+                    auto remaining = static_cast<std::size_t>(end - bump);
+                    if (remaining >= chunk_size(min_size_class)) n = std::max(n, chunk_size(last_bit(remaining)));
+                    return n < sizeof(chunk_header) ? 0 : n - sizeof(chunk_header);
+                }
+
+                // Size of the chunk needed to satisfy an allocation (in bytes, including header).
+                static std::size_t required_chunk_size(std::size_t n, std::size_t align) noexcept
+                {
+                    if (align < alignof(chunk_header)) align = alignof(chunk_header);
+                    return chunk_size(size_class(n + sizeof(chunk_header) + align - alignof(chunk_header)));
+                }
+
+                // Size of the chunk backing an allocation (in bytes, including header).
+                static std::size_t chunk_size(const void* p) noexcept { return chunk_size((reinterpret_cast<const chunk_header*>(p) - 1)->size_class); }
+
+                bool in_pool(const void* ptr) const noexcept
+                {
+                    auto* p = static_cast<const byte*>(ptr);
+                    return p > begin && p < end;
+                }
+
+                bool empty() const noexcept { return in_use == 0; }
+
+                // Discard all chunks and start over with a new block of memory.
+                void reset(byte* p, std::size_t size_bytes) noexcept
+                {
+                    free_lists.fill(nullptr);
+                    free_classes = 0;
+                    in_use = 0;
+                    begin = p;
+                    end = p + size_bytes;
+                    bump = aligned_ptr(p, chunk_size(min_size_class));
+                    if (bump > end) bump = end;
+                }
+
+            private:
+                struct free_node { free_node* next; };
+                struct chunk_header
+                {
+                    byte* chunk;
+                    std::size_t size_class;
+                };
+
+                static constexpr std::size_t chunk_size(std::size_t c) noexcept { return std::size_t { 1 } << c; }
+                static constexpr std::size_t bit(std::size_t c) noexcept { return std::size_t { 1 } << c; }
+                static std::size_t last_bit(std::size_t x) noexcept { return num_size_classes - 1 - __builtin_clzl(x); }
+
+                static std::size_t size_class(std::size_t n) noexcept
+                {
+                    if (n <= chunk_size(min_size_class)) return min_size_class;
+                    return num_size_classes - __builtin_clzl(n - 1);
+                }
+
+                static byte* aligned_ptr(byte* p, std::size_t align) noexcept
+                {
+                    auto a = reinterpret_cast<std::uintptr_t>(p);
+                    return reinterpret_cast<byte*>((a + align - 1) & -align);
+                }
+
+                byte* pop(std::size_t c) noexcept
+                {
+                    auto* f = free_lists[c];
+                    if (f == nullptr) return nullptr;
+                    free_lists[c] = f->next;
+                    if (f->next == nullptr) free_classes &= ~bit(c);
+                    return reinterpret_cast<byte*>(f);
+                }
+
+                void push(std::size_t c, byte* chunk) noexcept
+                {
+                    free_lists[c] = new(chunk) free_node { free_lists[c] };
+                    free_classes |= bit(c);
+                }
+
+                // Take a new chunk from the untouched end of the pool.
+                byte* carve(std::size_t c) noexcept
+                {
+                    if (chunk_size(c) > static_cast<std::size_t>(end - bump)) return nullptr;
+                    auto* p = bump;
+                    bump += chunk_size(c);
+                    return p;
+                }
+
+                // Split the smallest available larger chunk, keeping the upper halves as free chunks.
+                byte* split(std::size_t c) noexcept
+                {
+                    if (c + 1 >= num_size_classes) return nullptr;
+                    auto larger = free_classes & (~std::size_t { 0 } << (c + 1));
+                    if (larger == 0) return nullptr;
+                    auto j = static_cast<std::size_t>(__builtin_ctzl(larger));
+                    auto* p = pop(j);
+                    while (j > c)
+                    {
+                        --j;
+                        push(j, p + chunk_size(j));
+                    }
+                    return p;
+                }
+
+                std::array<free_node*, num_size_classes> free_lists;
+                std::size_t free_classes;   // bitmap of non-empty free lists
+                std::size_t in_use;
+                byte* begin;
+                byte* bump;
+                byte* end;
+            };
+        }
+
+        namespace detail
+        {
+            // Locked memory and segregated_pool for locked_segregated_pool_allocator, shared by all rebound copies.
+            struct locked_segregated_pool : allocator_statistics_node
+            {
+                std::vector<byte, locking_allocator<>> storage;
+                segregated_pool pool;
+
+                locked_segregated_pool(std::size_t size_bytes, const char* name)
+                    : allocator_statistics_node(name), storage(size_bytes), pool(storage.data(), storage.size()) { }
+
+            protected:
+                virtual std::size_t largest_free_chunk() const noexcept override { return pool.max_size(); }
+            };
+        }
+
+        // Segregated-fit counterpart of locked_pool_allocator. Allocations are rounded up to a power-of-two size
+        // class, and each size class keeps its own free list. This makes allocate() and deallocate() constant-time,
+        // so interrupt latency does not depend on how full the pool is. The trade-off is space: each allocation
+        // takes up to twice its size, plus a header of two pointers, and free chunks are never merged.
+        template<typename T = byte>
+        struct locked_segregated_pool_allocator : class_lock<locked_segregated_pool_allocator<T>>
+        {
+            using value_type = T;
+            using pointer = T*;
+
+            auto allocate(std::size_t num_elements)
+            {
+                if (!config::enable_allocator_statistics) return static_cast<pointer>(pool->pool.allocate(num_elements * sizeof(T), alignof(T)));
+
+                interrupt_mask no_interrupts_please { };
+                auto* p = pool->pool.try_allocate(num_elements * sizeof(T), alignof(T));
+                if (p == nullptr)
+                {
+                    pool->stats.failed();
+                    throw std::bad_alloc { };
+                }
+                pool->stats.allocated(detail::segregated_pool::chunk_size(p));
+                return static_cast<pointer>(p);
+            }
+
+            void deallocate(pointer p, std::size_t)
+            {
+                if (config::enable_allocator_statistics)
+                {
+                    interrupt_mask no_interrupts_please { };
+                    pool->stats.deallocated(detail::segregated_pool::chunk_size(p));
+                }
+                pool->pool.deallocate(p);
             }
 
+            // Resize the memory pool. Throws std::bad_alloc if the pool is still in use.
+            void resize(std::size_t size_bytes)
+            {
+                if (!pool->pool.empty()) throw std::bad_alloc { };
+
+                interrupt_mask no_interrupts_please { };
+                dpmi::trap_mask dont_trap_here { };
+                pool->storage.clear();
+                pool->storage.resize(size_bytes);
+                pool->pool.reset(pool->storage.data(), pool->storage.size());
+            }
+
+            // Returns maximum number of elements that can be allocated at once.
+            auto max_size() const noexcept
+            {
+                auto n = pool->pool.max_size();
+                return n < alignof(T) ? 0 : (n - alignof(T)) / sizeof(T);
+            }
+
+            bool in_pool(auto* ptr) const noexcept { return pool->pool.in_pool(ptr); }
+
+            // Returns usage statistics for this memory pool.
+            allocator_statistics get_statistics() const noexcept { return pool->get_statistics(); }
+
+            locked_segregated_pool_allocator() = delete;
+            locked_segregated_pool_allocator(locked_segregated_pool_allocator&&) = default;
+            locked_segregated_pool_allocator(const locked_segregated_pool_allocator&) = default;
+            locked_segregated_pool_allocator& operator=(const locked_segregated_pool_allocator&) = default;
+
+            locked_segregated_pool_allocator(std::size_t size_bytes, const char* name = "locked_segregated_pool_allocator")
+                : pool(std::allocate_shared<pool_type>(locking_allocator<> { }, size_bytes, name)) { }
+
+            template <typename U> friend class locked_segregated_pool_allocator;
+            template <typename U> locked_segregated_pool_allocator(const locked_segregated_pool_allocator<U>& c) : pool(c.pool) { }
+
+            template <typename U> struct rebind { using other = locked_segregated_pool_allocator<U>; };
+            template <typename U> constexpr friend bool operator== (const locked_segregated_pool_allocator& a, const locked_segregated_pool_allocator<U>& b) noexcept { return a.pool == b.pool; }
+            template <typename U> constexpr friend bool operator!= (const locked_segregated_pool_allocator& a, const locked_segregated_pool_allocator<U>& b) noexcept { return !(a == b); }
+
+        protected:
+            using pool_type = detail::locked_segregated_pool;
+
+            std::shared_ptr<pool_type> pool;
+        };
+
+        namespace detail
+        {
+            // Object cache for slab_allocator. There is one cache for each combination of object size, alignment
+            // and slab size, shared by all types that match.
+            // Memory is obtained from locking_allocator in slabs of N objects, and free objects are kept in an
+            // intrusive list. Slabs are only returned when the cache is destroyed.
+            template<std::size_t size, std::size_t align, std::size_t N>
+            struct slab_cache : class_lock<slab_cache<size, align, N>>, allocator_statistics_node
+            {
+                static constexpr std::size_t object_size { (std::max(size, sizeof(void*)) + align - 1) & -align };
+
+                static slab_cache& instance()
+                {
+                    static slab_cache cache { };
+                    return cache;
+                }
+
+                // Grows the cache when empty, unless called in interrupt context.
+                void* allocate()
+                {
+                    while (true)
+                    {
+                        {
+                            interrupt_mask no_interrupts_please { };
+                            if (__builtin_expect(free_list != nullptr, true))
+                            {
+                                auto* p = free_list;
+                                free_list = p->next;
+                                --num_free;
+                                if (config::enable_allocator_statistics) stats.allocated(object_size);
+                                return p;
+                            }
+                            if (in_irq_context())
+                            {
+                                if (config::enable_allocator_statistics) stats.failed();
+                                throw std::bad_alloc { };
+                            }
+                        }
+                        grow();
+                    }
+                }
+
+                void deallocate(void* ptr) noexcept
+                {
+                    auto* p = static_cast<free_node*>(ptr);
+                    interrupt_mask no_interrupts_please { };
+                    p->next = free_list;
+                    free_list = p;
+                    ++num_free;
+                    if (config::enable_allocator_statistics) stats.deallocated(object_size);
+                }
+
+                // Grow until at least n objects are free.
+                void reserve(std::size_t n)
+                {
+                    while (num_free < n) grow();
+                }
+
+                // Set the name shown in allocator statistics. Caches are shared, so only the first name is kept.
+                void set_name(const char* n) noexcept { if (name == default_name) name = n; }
+
+                ~slab_cache()
+                {
+                    while (slabs != nullptr)
+                    {
+                        auto* next = slabs->next;
+                        locking_allocator<> { }.deallocate(slabs->memory, slab_bytes);
+                        slabs = next;
+                    }
+                }
+
+            protected:
+                virtual std::size_t largest_free_chunk() const noexcept override { return free_list != nullptr ? object_size : 0; }
+
+            private:
+                static constexpr const char* default_name { "slab_allocator" };
+
+                slab_cache() : allocator_statistics_node(default_name) { }
+
+                struct free_node { free_node* next; };
+                struct slab_header
+                {
+                    slab_header* next;
+                    byte* memory;
+                };
+
+                // Each slab holds N objects, followed by its header.
+                static constexpr std::size_t header_offset { (object_size * N + alignof(slab_header) - 1) & -alignof(slab_header) };
+                static constexpr std::size_t slab_bytes { header_offset + sizeof(slab_header) + align - 1 };
+
+                void grow()
+                {
+                    auto* memory = locking_allocator<> { }.allocate(slab_bytes);
+                    auto* objects = reinterpret_cast<byte*>((reinterpret_cast<std::uintptr_t>(memory) + align - 1) & -align);
+                    free_node* list { nullptr };
+                    for (auto i = N; i-- > 0;) list = new(objects + i * object_size) free_node { list };
+
+                    interrupt_mask no_interrupts_please { };
+                    slabs = new(objects + header_offset) slab_header { slabs, memory };
+                    reinterpret_cast<free_node*>(objects + (N - 1) * object_size)->next = free_list;
+                    free_list = list;
+                    num_free += N;
+                }
+
+                free_node* free_list { nullptr };
+                slab_header* slabs { nullptr };
+                std::size_t num_free { 0 };
+            };
+        }
+
+        // Allocator for fixed-size objects. Single objects are allocated from a slab_cache in constant time, and
+        // are suitable for use in interrupt handlers. Arrays are forwarded to locking_allocator.
+        // All slab_allocators for types of the same size and alignment share one cache. When the cache is empty it
+        // grows by N objects, but only outside interrupt context. Use reserve() to make sure enough objects are
+        // available to interrupt handlers. A name can be given to identify the cache in allocator statistics.
+        template<typename T, std::size_t N = 32>
+        struct slab_allocator
+        {
+            using value_type = T;
+            using pointer = T*;
+
+            pointer allocate(std::size_t n)
+            {
+                if (__builtin_expect(n != 1, false)) return locking_allocator<T> { }.allocate(n);
+                return static_cast<pointer>(cache().allocate());
+            }
+
+            void deallocate(pointer p, std::size_t n)
+            {
+                if (__builtin_expect(n != 1, false)) return locking_allocator<T> { }.deallocate(p, n);
+                cache().deallocate(p);
+            }
+
+            // Make sure n objects can be allocated without growing the cache.
+            static void reserve(std::size_t n) { cache().reserve(n); }
+
+            // Returns usage statistics for the cache used by this allocator.
+            static allocator_statistics get_statistics() noexcept { return cache().get_statistics(); }
+
+            constexpr slab_allocator() noexcept = default;
+            explicit slab_allocator(const char* name) { cache().set_name(name); }
+            template <typename U> constexpr slab_allocator(const slab_allocator<U, N>&) noexcept { }
+
+            template <typename U> struct rebind { using other = slab_allocator<U, N>; };
+            template <typename U> constexpr friend bool operator== (const slab_allocator&, const slab_allocator<U, N>&) noexcept { return true; }
+            template <typename U> constexpr friend bool operator!= (const slab_allocator& a, const slab_allocator<U, N>& b) noexcept { return !(a == b); }
+
+        private:
+            static auto& cache() { return detail::slab_cache<sizeof(T), alignof(T), N>::instance(); }
+        };
+
+        class locking_memory_resource : public std::experimental::pmr::memory_resource
+        {
         protected:
             virtual void* do_allocate(std::size_t n, std::size_t a) override
             {
                 throw_if_irq();
-                if (map == nullptr) map = new std::map<void*, ptr_with_lock> { };
-                void* p = ::operator new(n + a);
-                void* ap = reinterpret_cast<void*>((reinterpret_cast<std::uintptr_t>(p) & -a) + a);
-                map->emplace(ap, ptr_with_lock { p, n + a });
+                auto size = total_size(n, a);
+                void* p = ::operator new(size);
+                try { detail::page_lock_table::lock(p, size); }
+                catch (...)
+                {
+                    ::operator delete(p);
+                    throw;
+                }
+                // The original pointer is stored just before the aligned pointer.
+                auto* ap = reinterpret_cast<void**>((reinterpret_cast<std::uintptr_t>(p) + sizeof(void*) + a - 1) & -a);
+                ap[-1] = p;
                 return ap;
             }
 
-            virtual void do_deallocate(void* ap, std::size_t, std::size_t) noexcept override
+            virtual void do_deallocate(void* ap, std::size_t n, std::size_t a) noexcept override
             {
-                auto* p = map->at(ap).p;
-                map->erase(ap);
+                auto* p = static_cast<void**>(ap)[-1];
+                detail::page_lock_table::unlock(p, total_size(n, a));
                 ::operator delete(p);
             }
 
@@ -255,16 +820,141 @@ namespace jw
                 return (o != nullptr);
             }
 
-            struct ptr_with_lock
+        private:
+            static constexpr std::size_t total_size(std::size_t n, std::size_t a) noexcept { return n + sizeof(void*) + a - 1; }
+        };
+
+        // Memory resource that allocates from pools of locked memory, so it can be used from interrupt handlers.
+        // Memory is obtained from an upstream resource in arenas, each of which is a segregated-fit pool (see
+        // locked_segregated_pool_allocator). When all arenas are full, a new one is allocated, but only outside of
+        // interrupt context. Within an interrupt, allocation fails with std::bad_alloc instead.
+        // Arenas are only returned upstream on release() or destruction. Usage statistics are collected under the
+        // given name, like the pool allocators.
+        class locked_pool_resource : class_lock<locked_pool_resource>, public std::experimental::pmr::memory_resource, public detail::allocator_statistics_node
+        {
+        public:
+            locked_pool_resource(std::size_t initial_size, const char* name = "locked_pool_resource", std::experimental::pmr::memory_resource* upstream = std::experimental::pmr::get_default_resource())
+                : allocator_statistics_node(name), upstream(upstream), next_arena_size(initial_size)
             {
-                void* p;
+                grow(0, 1);
+            }
+
+            virtual ~locked_pool_resource() { release(); }
+
+            locked_pool_resource(const locked_pool_resource&) = delete;
+            locked_pool_resource& operator=(const locked_pool_resource&) = delete;
+
+            // Return all arenas to the upstream resource, invalidating all memory allocated from this resource.
+            void release()
+            {
+                while (arenas != nullptr)
+                {
+                    auto* a = arenas;
+                    {
+                        interrupt_mask no_interrupts_please { };
+                        arenas = a->next;
+                    }
+                    auto size = a->size;
+                    a->~arena();
+                    upstream->deallocate(a, size, alignof(arena));
+                }
+                stats.bytes_in_use = 0;
+            }
+
+            // Allocate a new arena large enough for at least one allocation of given size and alignment.
+            // Can not be called from interrupt context.
+            void grow(std::size_t n, std::size_t align)
+            {
+                throw_if_irq();
+                if (n > std::numeric_limits<std::size_t>::max() / 4) throw std::bad_alloc { };
+                auto size = std::max(next_arena_size, 2 * (sizeof(arena) + detail::segregated_pool::required_chunk_size(n, align)));
+                auto* a = new(upstream->allocate(size, alignof(arena))) arena { arenas, size };
+                interrupt_mask no_interrupts_please { };
+                arenas = a;
+                next_arena_size = size * 2;
+            }
+
+            auto* upstream_resource() const noexcept { return upstream; }
+
+        protected:
+            virtual void* do_allocate(std::size_t n, std::size_t a) override
+            {
+                auto* p = try_allocate(n, a);
+                if (__builtin_expect(p != nullptr, true)) return p;
+                try
+                {
+                    if (in_irq_context()) throw std::bad_alloc { };
+                    grow(n, a);
+                    p = try_allocate(n, a);
+                    if (p == nullptr) throw std::bad_alloc { };
+                }
+                catch (...)
+                {
+                    if (config::enable_allocator_statistics)
+                    {
+                        interrupt_mask no_interrupts_please { };
+                        stats.failed();
+                    }
+                    throw;
+                }
+                return p;
+            }
+
+            virtual void do_deallocate(void* p, std::size_t n, std::size_t) noexcept override
+            {
+                interrupt_mask no_interrupts_please { };
+                for (auto* a = arenas; a != nullptr; a = a->next)
+                {
+                    if (!a->pool.in_pool(p)) continue;
+                    a->pool.deallocate(p);
+                    if (config::enable_allocator_statistics) stats.deallocated(n);
+                    return;
+                }
+                assert(!"locked_pool_resource: pointer was not allocated from this resource");
+            }
+
+            virtual bool do_is_equal(const std::experimental::pmr::memory_resource& other) const noexcept override
+            {
+                return this == &other;
+            }
+
+            virtual std::size_t largest_free_chunk() const noexcept override
+            {
+                std::size_t n { 0 };
+                for (auto* a = arenas; a != nullptr; a = a->next) n = std::max(n, a->pool.max_size());
+                return n;
+            }
+
+        private:
+            // Arenas are linked in a list, newest first. Each arena is stored at the start of its own memory block.
+            struct arena
+            {
+                arena* next;
+                std::size_t size;
                 data_lock lock;
-                ptr_with_lock(void* _p, std::size_t n) : p(_p), lock(p, n) { }
+                detail::segregated_pool pool;
+
+                arena(arena* n, std::size_t size_bytes)
+                    : next(n), size(size_bytes), lock(static_cast<const void*>(this), size_bytes),
+                    pool(reinterpret_cast<byte*>(this + 1), size_bytes - sizeof(arena)) { }
             };
 
-            static std::map<void*, ptr_with_lock>* map;
-        };
+            void* try_allocate(std::size_t n, std::size_t align) noexcept
+            {
+                interrupt_mask no_interrupts_please { };
+                for (auto* a = arenas; a != nullptr; a = a->next)
+                {
+                    auto* p = a->pool.try_allocate(n, align);
+                    if (p == nullptr) continue;
+                    if (config::enable_allocator_statistics) stats.allocated(n);
+                    return p;
+                }
+                return nullptr;
+            }
 
-        // TODO: locked_pool_resource
+            std::experimental::pmr::memory_resource* upstream;
+            arena* arenas { nullptr };
+            std::size_t next_arena_size;
+        };
     }
 }
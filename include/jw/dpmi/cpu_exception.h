@@ -220,7 +220,7 @@ namespace jw
         public:
             template<typename F>    // TODO: real-mode (requires a separate wrapper list)
             exception_handler(exception_num e, F&& f, bool = false)
-                : handler(std::allocator_arg, locking_allocator<> { }, std::forward<F>(f))
+                : handler(std::allocator_arg, slab_allocator<typename func::detail::functor_type<std::decay_t<F>>::type> { "exception handlers" }, std::forward<F>(f))
                 , exc(e), stack_ptr(stack.data() + stack.size() - 4)
             {
                 detail::setup_exception_throwers();
@@ -2,7 +2,9 @@
 /* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
 
 #pragma once
+#include <algorithm>
 #include <jw/dpmi/alloc.h>
+#include <jw/thread/dpc.h>
 #include <../jwdpmi_config.h>
 
 namespace jw
@@ -11,37 +13,187 @@ namespace jw
     {
         namespace detail
         {
-            struct new_allocator : locked_pool_allocator<byte>
+            // Memory pool for operator new() in interrupt context.
+            // When more than half of the current pool is in use, a DPC is queued that allocates a new pool, twice
+            // the size. New allocations then switch over to the new pool, while the old one is retired and freed
+            // once all its allocations are returned. Growing the pool never has to wait for it to be empty.
+            struct new_allocator : class_lock<new_allocator>, allocator_statistics_node
             {
-                using base = locked_pool_allocator<byte>;
-
-                auto allocate(std::size_t n)
+                void* allocate(std::size_t n)
                 {
                     dpmi::trap_mask dont_trap_here { };
-                    return reinterpret_cast<void*>(base::allocate(n));
-                    minimum_chunk_size = base::max_size();
+                    void* p;
+                    {
+                        interrupt_mask no_interrupts_please { };
+                        p = current->try_allocate(n);
+                        for (auto i = retired.begin(); p == nullptr && i != retired.end(); ++i) p = (*i)->try_allocate(n);
+                        if (config::enable_allocator_statistics && p != nullptr) stats.allocated(segregated_pool::chunk_size(p));
+                        if (__builtin_expect(current->in_use > (current->storage.size() >> 1) && !growing, false))
+                            growing = queue_grow();
+                    }
+                    if (__builtin_expect(p == nullptr, false))
+                    {
+                        if (config::enable_allocator_statistics) stats.failed();
+                        throw std::bad_alloc { };
+                    }
+                    return p;
                 }
 
-                auto deallocate(void* p)
+                void deallocate(void* p)
                 {
                     dpmi::trap_mask dont_trap_here { };
-                    return base::deallocate(reinterpret_cast<byte*>(p), 1);
+                    pool* empty { nullptr };
+                    {
+                        interrupt_mask no_interrupts_please { };
+                        if (config::enable_allocator_statistics) stats.deallocated(segregated_pool::chunk_size(p));
+                        if (current->in_pool(p))
+                        {
+                            current->deallocate(p);
+                            return;
+                        }
+                        for (auto i = retired.begin(); i != retired.end(); ++i)
+                        {
+                            if (!(*i)->in_pool(p)) continue;
+                            (*i)->deallocate(p);
+                            if ((*i)->in_use > 0) return;
+                            if (in_irq_context())
+                            {
+                                if (!growing) growing = queue_grow();
+                                return;
+                            }
+                            empty = *i;
+                            retired.erase(i);
+                            break;
+                        }
+                    }
+                    delete empty;
+                }
+
+                bool in_pool(const void* p) const noexcept
+                {
+                    if (current->in_pool(p)) return true;
+                    for (auto* i : retired) if (i->in_pool(p)) return true;
+                    return false;
+                }
+
+                new_allocator() : allocator_statistics_node("operator new() in interrupt context"), current(new pool { config::interrupt_initial_memory_pool }) { }
+
+                ~new_allocator()
+                {
+                    delete current;
+                    for (auto* i : retired) delete i;
                 }
 
-                new_allocator() : base(config::interrupt_initial_memory_pool), minimum_chunk_size(base::max_size()) { }
+            protected:
+                virtual std::size_t largest_free_chunk() const noexcept override
+                {
+                    auto n = current->alloc.max_size();
+                    for (auto* i : retired) n = std::max(n, i->alloc.max_size());
+                    return n;
+                }
 
-                void resize_if_necessary()
+            private:
+                struct pool : class_lock<pool>
                 {
-                    if (__builtin_expect(minimum_chunk_size <= (base::pool->size() >> 1), false))
+                    pool(std::size_t size_bytes) : storage(size_bytes), alloc(storage.data(), storage.size()) { }
+
+                    void* try_allocate(std::size_t n) noexcept
                     {
-                        dpmi::trap_mask dont_trap_here { };
-                        base::resize(base::pool->size() << 1);
+                        auto* p = alloc.try_allocate(n, alignof(std::max_align_t));
+                        if (p != nullptr) in_use += segregated_pool::chunk_size(p);
+                        return p;
+                    }
+
+                    void deallocate(void* p) noexcept
+                    {
+                        in_use -= segregated_pool::chunk_size(p);
+                        alloc.deallocate(p);
+                    }
+
+                    bool in_pool(const void* p) const noexcept { return alloc.in_pool(p); }
+
+                    std::vector<byte, locking_allocator<>> storage;
+                    segregated_pool alloc;
+                    std::size_t in_use { 0 };
+                };
+
+                // Returns false if the DPC queue is full, so the next allocation tries again.
+                bool queue_grow() noexcept { return thread::queue_dpc([this] { grow(); }); }
+
+                // Runs outside interrupt context, as a DPC. If this throws, growing is reset so the next allocation tries again.
+                void grow()
+                {
+                    try
+                    {
+                        std::unique_ptr<pool> p { };
+                        if (current->in_use > (current->storage.size() >> 1))
+                        {
+                            p = std::make_unique<pool>(current->storage.size() << 1);
+                            retired.reserve(retired.size() + 1);
+                        }
+
+                        std::vector<pool*> empty { };
+                        empty.reserve(retired.size() + 1);
+                        {
+                            interrupt_mask no_interrupts_please { };
+                            if (p != nullptr)
+                            {
+                                retired.push_back(current);
+                                current = p.release();
+                            }
+                            auto i = std::partition(retired.begin(), retired.end(), [](auto* r) { return r->in_use > 0; });
+                            empty.assign(i, retired.end());
+                            retired.erase(i, retired.end());
+                            growing = false;
+                        }
+                        for (auto* i : empty) delete i;
+                    }
+                    catch (...)
+                    {
+                        interrupt_mask no_interrupts_please { };
+                        growing = false;
+                        throw;
                     }
                 }
 
+                pool* current;
+                std::vector<pool*, locking_allocator<>> retired { };
+                bool growing { false };     // only accessed with interrupts masked
+            };
+
+            // Bump-pointer arena for operator new() in interrupt context, see config::interrupt_arena_size.
+            // Each interrupt saves a mark() on entry, and release()s everything above it on return.
+            struct interrupt_arena : class_lock<interrupt_arena>
+            {
+                interrupt_arena(std::size_t size_bytes) : storage(size_bytes) { }
+
+                // Returns nullptr if the arena is full.
+                void* allocate(std::size_t n) noexcept
+                {
+                    // No interrupt_mask required here. A nested interrupt may allocate from the same position,
+                    // but it will have released that memory again before we continue.
+                    constexpr std::size_t align = alignof(std::max_align_t);
+                    auto p = (top + align - 1) & -align;
+                    if (__builtin_expect(p > storage.size() || n > storage.size() - p, false)) return nullptr;
+                    top = p + n;
+                    return storage.data() + p;
+                }
+
+                bool in_arena(const void* ptr) const noexcept
+                {
+                    auto* p = static_cast<const byte*>(ptr);
+                    return p >= storage.data() && p < storage.data() + storage.size();
+                }
+
+                std::size_t mark() const noexcept { return top; }
+                void release(std::size_t m) noexcept { top = m; }
+
             private:
-                std::size_t minimum_chunk_size;
+                std::vector<byte, locking_allocator<>> storage;
+                std::size_t top { 0 };
             };
+
+            extern interrupt_arena* irq_arena;
         }
     }
 }
@@ -0,0 +1,164 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
+
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include <new>
+#include <jw/common.h>
+#include <jw/dpmi/irq_check.h>
+
+namespace jw
+{
+    namespace dpmi
+    {
+        namespace detail
+        {
+            // Size-class heap for small allocations, see config::enable_builtin_heap.
+            // Memory is obtained from block_source in large blocks, which are divided into 64KB spans. Each span
+            // holds objects of a single size class, and each size class keeps an intrusive free list. A span map
+            // records the size class of each span, so no per-object header is needed.
+            // Threads are cooperative, so the free lists behave like a thread cache without any locking. The heap is
+            // never allocated from in interrupt context. Objects freed in interrupt context are pushed on a separate
+            // list, which is returned to the free lists on the next refill.
+            // block_source must provide a static function allocate(std::size_t) that returns a pointer to at least
+            // the requested number of bytes, aligned to span_size, or throws std::bad_alloc.
+            template<typename block_source>
+            class basic_heap
+            {
+            public:
+                static constexpr std::size_t span_shift { 16 };
+                static constexpr std::size_t span_size { 1 << span_shift };
+                static constexpr std::size_t max_size { 4096 };     // larger allocations are not handled here
+                static constexpr std::size_t num_size_classes { 20 };
+
+                constexpr basic_heap(std::size_t block_bytes) noexcept : block_size(block_bytes) { }
+
+                basic_heap(const basic_heap&) = delete;
+                basic_heap& operator=(const basic_heap&) = delete;
+
+                // Allocate n bytes, where n <= max_size.
+                void* allocate(std::size_t n)
+                {
+                    auto c = size_class(n);
+                    if (__builtin_expect(free_lists[c] == nullptr, false)) refill(c);
+                    auto* p = free_lists[c];
+                    free_lists[c] = p->next;
+                    return p;
+                }
+
+                void deallocate(void* ptr) noexcept
+                {
+                    auto* p = static_cast<free_node*>(ptr);
+                    if (__builtin_expect(in_irq_context(), false))
+                    {
+                        p->next = remote_list;
+                        while (!__atomic_compare_exchange_n(&remote_list, &p->next, p, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) { }
+                        return;
+                    }
+                    auto c = span_map[span_index(p)] - 1;
+                    p->next = free_lists[c];
+                    free_lists[c] = p;
+                }
+
+                // Returns true if this memory was allocated from this heap.
+                bool owns(const void* ptr) const noexcept
+                {
+                    auto p = reinterpret_cast<std::uintptr_t>(ptr);
+                    if (p < lowest || p >= highest) return false;
+                    return span_map[span_index(ptr)] != 0;
+                }
+
+                static constexpr std::size_t size_class(std::size_t n) noexcept
+                {
+                    if (n <= 256) return n == 0 ? 0 : (n - 1) >> 4;
+                    return 16 + (std::numeric_limits<unsigned long>::digits - __builtin_clzl(n - 1)) - 9;
+                }
+
+                static constexpr std::size_t class_size(std::size_t c) noexcept
+                {
+                    if (c < 16) return (c + 1) << 4;
+                    return std::size_t { 512 } << (c - 16);
+                }
+
+            private:
+                struct free_node { free_node* next; };
+                struct span_range
+                {
+                    byte* pos;
+                    byte* end;
+                };
+
+                static constexpr std::size_t span_index(const void* p) noexcept
+                {
+                    return (reinterpret_cast<std::uintptr_t>(p) >> span_shift) & (span_map_size - 1);
+                }
+
+                // Fill the free list for size class c.
+                void refill(std::size_t c)
+                {
+                    if (remote_list != nullptr)
+                    {
+                        auto* p = __atomic_exchange_n(&remote_list, nullptr, __ATOMIC_ACQUIRE);
+                        while (p != nullptr)
+                        {
+                            auto* next = p->next;
+                            deallocate(p);
+                            p = next;
+                        }
+                        if (free_lists[c] != nullptr) return;
+                    }
+
+                    auto size = class_size(c);
+                    auto& s = spans[c];
+                    if (static_cast<std::size_t>(s.end - s.pos) < size)
+                    {
+                        auto* span = new_span();
+                        span_map[span_index(span)] = c + 1;
+                        s = span_range { span, span + span_size };
+                    }
+
+                    // Carve up to 4KB worth of objects at a time, so rarely used classes don't claim a whole span.
+                    auto n = std::max<std::size_t>(1, std::min<std::size_t>((s.end - s.pos) / size, 4096 / size));
+                    free_node* list { nullptr };
+                    for (auto i = n; i-- > 0;)
+                        list = new(s.pos + i * size) free_node { list };
+                    s.pos += n * size;
+                    free_lists[c] = list;
+                }
+
+                byte* new_span()
+                {
+                    if (block_pos == block_end)
+                    {
+                        auto* p = static_cast<byte*>(block_source::allocate(block_size));
+                        block_pos = p;
+                        block_end = p + (block_size & -span_size);
+                        auto lo = reinterpret_cast<std::uintptr_t>(block_pos);
+                        auto hi = reinterpret_cast<std::uintptr_t>(block_end);
+                        if (lowest == 0 || lo < lowest) lowest = lo;
+                        if (hi > highest) highest = hi;
+                    }
+                    auto* p = block_pos;
+                    block_pos += span_size;
+                    return p;
+                }
+
+                static constexpr std::size_t span_map_size { std::size_t { 1 } << (32 - span_shift) };
+
+                std::array<free_node*, num_size_classes> free_lists { };
+                std::array<span_range, num_size_classes> spans { };
+                free_node* remote_list { nullptr };
+                byte* block_pos { nullptr };
+                byte* block_end { nullptr };
+                std::size_t block_size;
+                std::uintptr_t lowest { 0 };
+                std::uintptr_t highest { 0 };
+                std::array<std::uint8_t, span_map_size> span_map { };   // size class + 1 for each span, 0 if unused
+            };
+        }
+    }
+}
@@ -37,7 +37,8 @@ namespace jw
             {   
                 template<typename F>
                 //irq_handler_base(F func, irq_config_flags f = { }) : handler_ptr(std::forward<F>(func)), flags(f) { }
-                irq_handler_base(F&& func, irq_config_flags f = { }) : handler_ptr(std::allocator_arg, locking_allocator<> { }, std::forward<F>(func)), flags(f) { }
+                irq_handler_base(F&& function, irq_config_flags f = { })
+                    : handler_ptr(std::allocator_arg, slab_allocator<typename func::detail::functor_type<std::decay_t<F>>::type> { "irq handlers" }, std::forward<F>(function)), flags(f) { }
                 irq_handler_base() = delete;
 
                 const func::function<void(ack_ptr)> handler_ptr; // TODO: figure out if the locking allocator is really necessary here.
@@ -171,13 +172,22 @@ namespace jw
                     irq_controller_data()
                     {
                         stack.resize(config::interrupt_initial_stack_size);
-                        increase_stack_size->name = "Increasing stack size for IRQ handlers";
                         pic0_cmd.write(0x68);   // TODO: restore to defaults
                         pic1_cmd.write(0x68);
                     }
 
-                    thread::task<void()> increase_stack_size { [this]() { stack.resize(stack.size() * 2); } };
-                    locked_pool_allocator<> alloc { 4_KB };
+                    void increase_stack_size()
+                    {
+                        try { stack.resize(stack.size() * 2); }
+                        catch (...)
+                        {
+                            stack_resize_pending = false;   // let the next interrupt try again
+                            throw;
+                        }
+                        stack_resize_pending = false;
+                    }
+                    bool stack_resize_pending { false };
+                    locked_pool_allocator<> alloc { 4_KB, "irq controller" };
                     std::vector<int_vector, locked_pool_allocator<>> current_int { alloc }; // Current interrupt vector. Set to 0 when acknowlegded.
                     std::map<int_vector, std::unique_ptr<irq_controller>, std::less<int_vector>, locking_allocator<>> entries { };
                     std::vector<byte, locking_allocator<>> stack { };
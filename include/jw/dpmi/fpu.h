@@ -10,6 +10,7 @@
 #include <jw/dpmi/lock.h>
 #include <jw/dpmi/alloc.h>
 #include <jw/dpmi/irq.h>
+#include <jw/dpmi/irq_mask.h>
 #include <jw/alloc.h>
 #include <jw/common.h>
 #include <../jwdpmi_config.h>
@@ -105,14 +106,22 @@ namespace jw
 
             class fpu_context_switcher_t : class_lock<fpu_context_switcher_t>
             {
-                locked_pool_allocator<fpu_context> alloc { config::interrupt_fpu_context_pool };
-                std::deque<fpu_context*, locked_pool_allocator<>> contexts { alloc };
+                slab_allocator<fpu_context> alloc { "fpu contexts" };
+                locked_pool_allocator<> contexts_alloc { config::interrupt_fpu_context_stack_size, "fpu context stack" };
+                std::deque<fpu_context*, locked_pool_allocator<>> contexts { contexts_alloc };
                 
                 fpu_context default_irq_context;
                 bool use_ts_bit { false };
                 bool init { false };
+                bool switch_pending { false };
                 std::uint32_t last_restored { 0 };
 
+                // Thread-level FPU state is switched lazily. thread_current points to the current thread's context
+                // slot, thread_owner to the slot of the thread whose state is loaded (or saved in contexts[0]).
+                fpu_context** thread_current { nullptr };
+                fpu_context** thread_owner { nullptr };
+                fpu_context* discarded { nullptr };
+
                 struct fpu_emulation_status
                 {
                     bool mp : 1;
@@ -154,19 +163,43 @@ namespace jw
                     return status;
                 }
                 
+                INTERRUPT void set_switch_pending(bool s)
+                {
+                    switch_pending = s;
+                    if (!use_ts_bit) set_fpu_emulation(s);
+                    else
+                    {
+                        cr0_t cr0 { };
+                        cr0.task_switched = s;
+                        cr0.set();
+                    }
+                }
+
                 INTERRUPT void switch_context()
                 {
-                    if (contexts.back() == nullptr)
+                    if (last_restored != contexts.size() - 1)
                     {
-                        if (last_restored < contexts.size() - 1)
+                        if (contexts.back() == nullptr)
                         {
-                            if (contexts[last_restored] == nullptr) contexts[last_restored] = alloc.allocate(1);
-                            contexts[last_restored]->save();
+                            if (last_restored < contexts.size() - 1)
+                            {
+                                if (contexts[last_restored] == nullptr) contexts[last_restored] = alloc.allocate(1);
+                                contexts[last_restored]->save();
+                            }
+                            default_irq_context.restore();
                         }
-                        default_irq_context.restore();
+                        else contexts.back()->restore();
+                        last_restored = contexts.size() - 1;
                     }
-                    else contexts.back()->restore();
-                    last_restored = contexts.size() - 1;
+                    if (contexts.size() == 1 && thread_current != thread_owner) switch_thread_context();
+                }
+
+                INTERRUPT void switch_thread_context()
+                {
+                    if (*thread_owner != nullptr) (*thread_owner)->save();     // no context if the owner has finished
+                    if (*thread_current != nullptr) (*thread_current)->restore();
+                    else default_irq_context.restore();
+                    thread_owner = thread_current;
                 }
 
             public:
@@ -177,13 +210,7 @@ namespace jw
                 {
                     if (__builtin_expect(!init, false)) return;
                     contexts.push_back(nullptr);
-                    if (!use_ts_bit) set_fpu_emulation(true);
-                    else
-                    {
-                        cr0_t cr0 { };
-                        cr0.task_switched = true;
-                        cr0.set();
-                    }
+                    set_switch_pending(true);
                 }
 
                 INTERRUPT void leave() noexcept
@@ -192,13 +219,39 @@ namespace jw
                     if (contexts.back() != nullptr) alloc.deallocate(contexts.back(), 1);
                     contexts.pop_back();
                     bool switch_required = last_restored != (contexts.size() - 1);
-                    if (!use_ts_bit) set_fpu_emulation(switch_required);
-                    else
-                    {
-                        cr0_t cr0 { };
-                        cr0.task_switched = switch_required;
-                        cr0.set();
-                    }
+                    if (contexts.size() == 1) switch_required |= thread_current != thread_owner;
+                    set_switch_pending(switch_required);
+                }
+
+                // Called by the scheduler on every thread switch, with interrupts disabled. Nothing is saved or
+                // restored here. If the new thread doesn't own the FPU, the next FPU instruction traps, and the
+                // state is swapped then. Threads that never use the FPU don't cost anything.
+                void switch_thread(fpu_context** prev, fpu_context** next) noexcept
+                {
+                    if (__builtin_expect(!init, false)) return;
+                    if (__builtin_expect(thread_owner == nullptr, false)) thread_owner = prev;
+                    thread_current = next;
+                    bool s = thread_current != thread_owner || last_restored != 0;
+                    if (s != switch_pending) set_switch_pending(s);
+                }
+
+                // Called by the scheduler before switching away from a thread, in thread context. If the thread's
+                // state is loaded in the FPU, it is saved when the next thread traps, so a context is allocated here.
+                // The trap handler can not allocate, since the slab cache only grows outside interrupt context.
+                void prepare_switch(fpu_context** slot)
+                {
+                    if (__builtin_expect(!init, false)) return;
+                    if (*slot != nullptr || (thread_owner != slot && thread_owner != nullptr)) return;
+                    *slot = alloc.allocate(1);
+                }
+
+                // Called when a thread finishes. Frees its saved state, and discards its state in the FPU.
+                void release_thread(fpu_context** slot) noexcept
+                {
+                    interrupt_mask no_interrupts_please { };
+                    if (thread_owner == slot) thread_owner = &discarded;
+                    if (*slot != nullptr) alloc.deallocate(*slot, 1);
+                    *slot = nullptr;
                 }
 
                 fpu_context* get_last_context()
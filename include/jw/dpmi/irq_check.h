@@ -13,6 +13,7 @@ namespace jw
         {
             extern volatile std::uint32_t interrupt_count;
             extern volatile std::uint32_t exception_count;
+            extern volatile std::uint64_t interrupt_cycles;     // see config::enable_thread_cpu_time
         }
 
         struct bad_irq_function_call : public std::runtime_error
@@ -3,6 +3,7 @@
 /* Copyright (C) 2016 J.W. Jagersma, see COPYING.txt for details */
 
 #pragma once
+#include <array>
 #include <jw/dpmi/memory.h>
 
 namespace jw
@@ -60,6 +61,38 @@ namespace jw
             };
         }
 
+        namespace detail
+        {
+            // Keeps a lock count for each page in the Data Segment. DPMI lock/unlock functions are only called when
+            // a page's count changes from 0 to 1 or back, so small allocations that share pages don't need a mode
+            // switch each. Adjacent pages that change state together are locked or unlocked with a single call.
+            class page_lock_table
+            {
+            public:
+                // Lock all pages touched by given memory region.
+                static void lock(const void* ptr, std::size_t num_bytes);
+                // Unlock all pages touched by given memory region, previously locked with lock().
+                static void unlock(const void* ptr, std::size_t num_bytes) noexcept;
+
+            private:
+                static constexpr std::size_t page_shift { 12 };
+                static constexpr std::size_t table_bits { 10 };
+                static constexpr std::size_t table_size { 1 << table_bits };
+                static constexpr std::size_t directory_size { 1 << (32 - page_shift - table_bits) };
+
+                using lock_count = std::uint16_t;
+                using table = std::array<lock_count, table_size>;
+
+                static lock_count& count(std::uintptr_t page) noexcept { return (*directory[page >> table_bits])[page & (table_size - 1)]; }
+                static table* new_table();
+                static void lock_pages(std::uintptr_t begin, std::uintptr_t end);
+                static void unlock_pages(std::uintptr_t begin, std::uintptr_t end) noexcept;
+                static void release(std::uintptr_t begin, std::uintptr_t end) noexcept;
+
+                static std::array<table*, directory_size> directory;
+            };
+        }
+
         // Locks the memory occupied by one or more objects (in Data Segment)
         struct data_lock final : protected detail::memory_lock
         {
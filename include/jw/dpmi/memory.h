@@ -3,6 +3,7 @@
 
 #pragma once
 #include <limits>
+#include <memory>
 #include <experimental/memory_resource>
 #include <jw/dpmi/dpmi.h>
 
@@ -449,6 +450,10 @@ namespace jw
                 else old_resize(num_bytes);
             }
 
+            // DPMI 1.0 AX=0507. Commits or uncommits the pages in the given range. Accessing an uncommitted page causes
+            // a page fault. Only works on blocks allocated with DPMI 1.0 functions.
+            void commit(std::size_t offset, std::size_t num_bytes, bool committed = true);
+
             std::uint32_t get_handle() const noexcept { return handle; }
             virtual operator bool() const noexcept { return handle != null_handle; }
             virtual std::ptrdiff_t get_offset_in_block() const noexcept { return 0; }
@@ -806,5 +811,69 @@ namespace jw
         template <typename T = byte> using device_memory = memory_t<T, device_memory_base>;
         template <typename T = byte> using mapped_dos_memory = memory_t<T, mapped_dos_memory_base>;
         template <typename T = byte> using dos_memory = memory_t<T, dos_memory_base>;
+
+        namespace detail
+        {
+            // Block of conventional memory shared by all dos_buffers, see config::dos_transfer_pool_size.
+            // It is allocated on first use, and divided in paragraphs.
+            struct dos_transfer_pool
+            {
+                // Returns the first of n consecutive free paragraphs, or -1 if there are none.
+                static std::ptrdiff_t allocate(std::size_t n);
+                static void deallocate(std::ptrdiff_t first, std::size_t n) noexcept;
+
+                static byte* get_ptr(std::ptrdiff_t first) noexcept;
+                static far_ptr16 get_dos_ptr(std::ptrdiff_t first) noexcept;
+            };
+        }
+
+        // Transfer buffer in conventional memory, for passing data to real-mode interrupt handlers.
+        // This has the same interface as dos_memory<T>, but is taken from a persistent pool, so it does not
+        // require a DOS memory allocation each time. Only when the pool is exhausted, a dos_memory is allocated.
+        template <typename T = byte>
+        struct dos_buffer
+        {
+            dos_buffer(std::size_t num_elements) : size(num_elements), paragraphs(bytes_to_paragraphs(num_elements * sizeof(T)))
+            {
+                first = detail::dos_transfer_pool::allocate(paragraphs);
+                if (__builtin_expect(first >= 0, true))
+                {
+                    ptr = reinterpret_cast<T*>(detail::dos_transfer_pool::get_ptr(first));
+                    dos_ptr = detail::dos_transfer_pool::get_dos_ptr(first);
+                }
+                else
+                {
+                    fallback = std::make_unique<dos_memory<T>>(num_elements);
+                    ptr = fallback->get_ptr();
+                    dos_ptr = fallback->get_dos_ptr();
+                }
+            }
+
+            ~dos_buffer() { if (first >= 0) detail::dos_transfer_pool::deallocate(first, paragraphs); }
+
+            dos_buffer(const dos_buffer&) = delete;
+            dos_buffer& operator=(const dos_buffer&) = delete;
+
+            auto* get_ptr() noexcept { return ptr; }
+            auto* operator->() noexcept { return get_ptr(); }
+            auto& operator*() noexcept { return *get_ptr(); }
+            auto& operator[](std::ptrdiff_t i) noexcept { return *(get_ptr() + i); }
+
+            const auto* get_ptr() const noexcept { return ptr; }
+            const auto* operator->() const noexcept { return get_ptr(); }
+            const auto& operator*() const noexcept { return *get_ptr(); }
+            const auto& operator[](std::ptrdiff_t i) const noexcept { return *(get_ptr() + i); }
+
+            far_ptr16 get_dos_ptr() const noexcept { return dos_ptr; }
+            std::size_t get_size() const noexcept { return size; }
+
+        private:
+            std::size_t size;
+            std::size_t paragraphs;
+            std::ptrdiff_t first;
+            T* ptr;
+            far_ptr16 dos_ptr;
+            std::unique_ptr<dos_memory<T>> fallback;
+        };
     }
 }
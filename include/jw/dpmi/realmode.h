@@ -150,7 +150,7 @@ namespace jw
             template<typename F>
             realmode_callback(F&& function, std::size_t pool_size = 1_KB) 
                 : realmode_callback_base(code.data())
-                , function_ptr(std::allocator_arg, locking_allocator<> { }, std::forward<F>(function))
+                , function_ptr(std::allocator_arg, slab_allocator<typename func::detail::functor_type<std::decay_t<F>>::type> { "realmode callbacks" }, std::forward<F>(function))
                 , alloc(pool_size), reg_pool(alloc) { init_code(); }
 
         private:
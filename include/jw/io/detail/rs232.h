@@ -17,6 +17,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
 #include <jw/thread/thread.h>
+#include <jw/spsc_ring.h>
 
 namespace jw
 {
@@ -119,6 +120,7 @@ namespace jw
 
             protected:
                 virtual int sync() override;
+                virtual std::streamsize showmanyc() override;
                 virtual std::streamsize xsgetn(char_type* s, std::streamsize n) override;
                 virtual int_type underflow() override;
                 virtual std::streamsize xsputn(const char_type* s, std::streamsize n) override;
@@ -131,7 +133,7 @@ namespace jw
                     auto r = modem_control.read();
                     auto r2 = r;
                     r2.dtr = true;
-                    r2.rts = rx_ptr != rx_buf.end();
+                    r2.rts = !rx_buf.full();
                     if (r.rts != r2.rts)
                     {
                         modem_control.write(r2);
@@ -142,9 +144,8 @@ namespace jw
                 void get(bool entire_fifo = false) noexcept
                 {
                     if (getting.test_and_set()) return;
-                    auto end = rx_ptr + std::min(entire_fifo ? 14 : 1, rx_buf.end() - rx_ptr);
-                    while (rx_ptr < end) *(rx_ptr++) = get_one();
-                    setg(rx_buf.begin(), gptr(), end);
+                    auto n = std::min<std::size_t>(entire_fifo ? 14 : 1, rx_buf.capacity() - rx_buf.size());
+                    while (n-- > 0) rx_buf.push_back(get_one());
                     getting.clear();
                 }
 
@@ -152,9 +153,9 @@ namespace jw
                 {
                     //if (config.flow_control == rs232_config::xon_xoff && !cts) { put_one(xon); return; };
                     if (putting.test_and_set()) return;
-                    auto end = tx_ptr + std::min(line_status.read().tx_fifo_empty ? 16 : 1, pptr() - tx_ptr);
-                    for (; tx_ptr < end; ++tx_ptr)
-                        if (!put_one(*tx_ptr)) break;
+                    auto n = std::min<std::size_t>(line_status.read().tx_fifo_empty ? 16 : 1, tx_buf.size());
+                    for (; n > 0; --n, tx_buf.pop())
+                        if (!put_one(tx_buf.front())) break;
                     putting.clear();
                 }
 
@@ -216,10 +217,9 @@ namespace jw
                 std::atomic_flag putting { false };
                 bool cts { false };
 
-                std::array<char_type, 1_KB> rx_buf;
-                std::array<char_type, 1_KB> tx_buf;
-                char_type* rx_ptr { rx_buf.data() };
-                char_type* tx_ptr { tx_buf.data() };
+                // The get area is the front of rx_buf, and the put area is the free space in tx_buf.
+                spsc_ring<char_type, 1_KB> rx_buf;
+                spsc_ring<char_type, 1_KB> tx_buf;
 
                 static const char_type xon = 0x11;
                 static const char_type xoff = 0x13;
@@ -6,6 +6,7 @@
 #include <jw/io/ioport.h>
 #include <jw/dpmi/irq.h>
 #include <jw/common.h>
+#include <jw/spsc_ring.h>
 
 namespace jw
 {
@@ -39,6 +40,7 @@ namespace jw
 
             protected:
                 virtual int sync() override;
+                virtual std::streamsize showmanyc() override;
                 virtual std::streamsize xsgetn(char_type* s, std::streamsize n) override;
                 virtual int_type underflow() override;
                 virtual std::streamsize xsputn(const char_type* s, std::streamsize n) override;
@@ -48,17 +50,19 @@ namespace jw
                 void get() noexcept
                 {
                     if (getting.test_and_set()) return;
-                    while (!status_port.read().no_data_available && rx_ptr < rx_buf.end()) 
-                        *(rx_ptr++) = data_port.read();
-                    setg(rx_buf.begin(), gptr(), rx_ptr);
+                    while (!status_port.read().no_data_available && !rx_buf.full())
+                        rx_buf.push_back(data_port.read());
                     getting.clear();
                 }
 
                 void put() noexcept
                 {
                     if (putting.test_and_set()) return;
-                    while (!status_port.read().dont_send_data && tx_ptr < pptr())
-                        data_port.write(*tx_ptr++);
+                    while (!status_port.read().dont_send_data && !tx_buf.empty())
+                    {
+                        data_port.write(tx_buf.front());
+                        tx_buf.pop();
+                    }
                     putting.clear();
                 }
 
@@ -76,10 +80,9 @@ namespace jw
                 std::atomic_flag getting { false };
                 std::atomic_flag putting { false };
 
-                std::array<char_type, 1_KB> rx_buf;
-                std::array<char_type, 1_KB> tx_buf;
-                char_type* rx_ptr { rx_buf.data() };
-                char_type* tx_ptr { tx_buf.data() };
+                // The get area is the front of rx_buf, and the put area is the free space in tx_buf.
+                spsc_ring<char_type, 1_KB> rx_buf;
+                spsc_ring<char_type, 1_KB> tx_buf;
 
                 static std::unordered_map<port_num, bool> port_use_map;
             };
@@ -23,6 +23,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <jw/io/ioport.h>
 #include <jw/thread/task.h>
 #include <jw/chrono/chrono.h>
+#include <jw/spsc_ring.h>
+#include <jw/thread/dpc.h>
 
 // TODO: clean this up
 // TODO: keyboard commands enum, instead of using raw hex values
@@ -185,9 +187,16 @@ namespace jw
             void write_config() { command<send_cmd, send_data>({ 0x60, config.data }); read_config(); }
 
             thread::task<void()> keyboard_update_thread;
+            bool update_pending { false };
 
-            dpmi::locked_pool_allocator<> alloc { 1_KB };
-            std::deque<detail::raw_scancode, dpmi::locked_pool_allocator<>> scancode_queue { alloc };
+            void start_keyboard_update()
+            {
+                update_pending = false;
+                if (keyboard_update_thread) keyboard_update_thread->start();
+            }
+
+            spsc_ring<detail::raw_scancode, 256> scancode_queue;    // filled by the irq handler
+            std::deque<detail::raw_scancode> pending_scancodes;     // incomplete sequences, not yet extracted
 
             dpmi::irq_handler irq_handler { [this](auto* ack) INTERRUPT
             {
@@ -199,7 +208,7 @@ namespace jw
                         if (config.translate_scancodes) *detail::scancode::undo_translation_inserter(scancode_queue) = c;
                         else scancode_queue.push_back(c);
                     } while (get_status().data_available);
-                    if (keyboard_update_thread) keyboard_update_thread->start();
+                    if (keyboard_update_thread && !update_pending) update_pending = thread::queue_dpc([this] { start_keyboard_update(); });
                     ack();
                 }
             }, dpmi::no_auto_eoi };
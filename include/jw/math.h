@@ -3,6 +3,9 @@
 
 #pragma once
 #include <cmath>
+#include <cstdint>
+#include <string>
+#include <jw/common.h>
 
 namespace jw
 {
@@ -0,0 +1,123 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
+
+#pragma once
+#include <array>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include <jw/dpmi/lock.h>
+
+namespace jw
+{
+    // Fixed-size ring buffer for passing data from one producer to one consumer, typically from an interrupt handler
+    // to a thread, or the other way around. Neither side ever blocks, allocates, or needs to disable interrupts.
+    // The storage is part of the object, and is locked.
+    // Each side may only be used from one context at a time. If both an interrupt handler and a thread can act as
+    // the producer (or consumer), they must exclude each other.
+    template<typename T, std::size_t N>
+    class spsc_ring : dpmi::class_lock<spsc_ring<T, N>>
+    {
+        static_assert(N > 0 && (N & (N - 1)) == 0, "spsc_ring size must be a power of two.");
+        static_assert(std::atomic<std::uint32_t>::is_always_lock_free);
+
+    public:
+        // Contiguous part of the ring.
+        struct range
+        {
+            T* first;
+            T* last;
+
+            T* begin() const noexcept { return first; }
+            T* end() const noexcept { return last; }
+            std::size_t size() const noexcept { return last - first; }
+            bool empty() const noexcept { return first == last; }
+        };
+
+        static constexpr std::size_t capacity() noexcept { return N; }
+        std::size_t size() const noexcept { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+        bool empty() const noexcept { return size() == 0; }
+        bool full() const noexcept { return size() == N; }
+
+        // Producer side.
+
+        // Appends one element. Returns false if the ring is full.
+        bool push_back(const T& value) noexcept
+        {
+            auto h = head.load(std::memory_order_relaxed);
+            if (h - tail.load(std::memory_order_acquire) == N) return false;
+            buffer[h & mask] = value;
+            head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Appends up to n elements. Returns the number of elements written.
+        std::size_t write(const T* src, std::size_t n) noexcept
+        {
+            std::size_t done = 0;
+            while (done < n)
+            {
+                auto r = write_range();
+                if (r.empty()) break;
+                auto k = std::min(r.size(), n - done);
+                std::copy_n(src + done, k, r.begin());
+                commit(k);
+                done += k;
+            }
+            return done;
+        }
+
+        // Returns the free space up to the end of the buffer, so that it can be filled in place. The consumer does
+        // not see any of it until commit() is called.
+        range write_range() noexcept
+        {
+            auto h = head.load(std::memory_order_relaxed);
+            auto free = N - (h - tail.load(std::memory_order_acquire));
+            auto* p = &buffer[h & mask];
+            return { p, p + std::min<std::size_t>(free, N - (h & mask)) };
+        }
+
+        // Publishes n elements written to the write_range().
+        void commit(std::size_t n) noexcept { head.store(head.load(std::memory_order_relaxed) + n, std::memory_order_release); }
+
+        // Consumer side.
+
+        // Returns the first element. The ring must not be empty.
+        const T& front() const noexcept { return buffer[tail.load(std::memory_order_relaxed) & mask]; }
+
+        // Returns the available elements up to the end of the buffer. If the data wraps around, call this again
+        // after pop() to get the rest.
+        range peek() noexcept
+        {
+            auto t = tail.load(std::memory_order_relaxed);
+            auto n = head.load(std::memory_order_acquire) - t;
+            auto* p = &buffer[t & mask];
+            return { p, p + std::min<std::size_t>(n, N - (t & mask)) };
+        }
+
+        // Removes n elements from the front. n may not be larger than size().
+        void pop(std::size_t n = 1) noexcept { tail.store(tail.load(std::memory_order_relaxed) + n, std::memory_order_release); }
+
+        // Removes up to n elements from the front, and copies them to dst. Returns the number of elements read.
+        std::size_t read(T* dst, std::size_t n) noexcept
+        {
+            std::size_t done = 0;
+            while (done < n)
+            {
+                auto r = peek();
+                if (r.empty()) break;
+                auto k = std::min(r.size(), n - done);
+                std::copy_n(r.begin(), k, dst + done);
+                pop(k);
+                done += k;
+            }
+            return done;
+        }
+
+    private:
+        static constexpr std::uint32_t mask { N - 1 };
+        std::array<T, N> buffer;
+        std::atomic<std::uint32_t> head { 0 };     // written by the producer
+        std::atomic<std::uint32_t> tail { 0 };     // written by the consumer
+    };
+}
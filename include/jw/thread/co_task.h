@@ -0,0 +1,369 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
+
+#pragma once
+#ifndef __cpp_impl_coroutine
+#error "jw/thread/co_task.h requires C++20 coroutines (-std=gnu++20, and -fcoroutines on gcc 10)."
+#endif
+
+#include <coroutine>
+#include <optional>
+#include <exception>
+#include <istream>
+#include <algorithm>
+#include <jw/thread/task.h>
+#include <jw/thread/dpc.h>
+#include <jw/chrono/chrono.h>
+#include <jw/dpmi/alloc.h>
+#include <../jwdpmi_config.h>
+
+namespace jw
+{
+    namespace thread
+    {
+        namespace detail
+        {
+            // Coroutine frames are allocated from locked memory, so that they can be scheduled from interrupt context.
+            inline dpmi::locked_segregated_pool_allocator<>& co_frame_pool()
+            {
+                static dpmi::locked_segregated_pool_allocator<> pool { config::coroutine_frame_pool_size, "co_task frames" };
+                return pool;
+            }
+
+            // A condition that a suspended coroutine is waiting for. If ready is nullptr, only the deadline is checked.
+            struct co_poll_node
+            {
+                bool (*ready)(co_poll_node*);
+                chrono::tsc::time_point deadline;
+            };
+
+            struct co_promise_base
+            {
+                co_promise_base* next { nullptr };      // in co_scheduler's ready list or poll list
+                std::coroutine_handle<> handle;
+                std::coroutine_handle<> continuation { };
+                co_poll_node* poll { nullptr };
+                wait_queue awaiters { };                // threads in co_task::await()
+                std::exception_ptr exception { };
+                bool started { false };
+                bool done { false };
+                bool detached { false };                // co_task object was destroyed while the coroutine was running
+
+                static void* operator new(std::size_t n)
+                {
+                    dpmi::interrupt_mask no_interrupts_please { };
+                    return co_frame_pool().allocate(n);
+                }
+
+                static void operator delete(void* p, std::size_t n)
+                {
+                    dpmi::interrupt_mask no_interrupts_please { };
+                    co_frame_pool().deallocate(static_cast<byte*>(p), n);
+                }
+
+                struct final_awaiter
+                {
+                    bool await_ready() const noexcept { return false; }
+                    template<typename P> std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept;
+                    void await_resume() const noexcept { }
+                };
+
+                std::suspend_always initial_suspend() const noexcept { return { }; }
+                final_awaiter final_suspend() const noexcept { return { }; }
+                void unhandled_exception() noexcept { exception = std::current_exception(); }
+
+                void rethrow()
+                {
+                    if (exception) std::rethrow_exception(exception);
+                }
+            };
+
+            template<typename R>
+            struct co_promise : co_promise_base
+            {
+                std::optional<R> result;
+
+                template<typename T> void return_value(T&& value) { result.emplace(std::forward<T>(value)); }
+                R get() { rethrow(); return std::move(*result); }
+            };
+
+            template<>
+            struct co_promise<void> : co_promise_base
+            {
+                void return_void() const noexcept { }
+                void get() { rethrow(); }
+            };
+
+            // Resumes coroutines on a single thread, which is started the first time a co_task is started.
+            // Each pass resumes all coroutines that were ready at the start of the pass, then checks the poll list,
+            // and yields to other threads. When there is nothing to do, the thread blocks until schedule() is called.
+            // If only sleeping coroutines are left, it sleeps until the earliest deadline, or until schedule().
+            struct co_scheduler
+            {
+                // Queues a coroutine to be resumed on the next pass. Safe in interrupt context.
+                static void schedule(co_promise_base* p) noexcept
+                {
+                    {
+                        dpmi::interrupt_mask no_interrupts_please { };
+                        p->next = nullptr;
+                        if (ready_tail != nullptr) ready_tail->next = p;
+                        else ready_head = p;
+                        ready_tail = p;
+                        if (!waiters.notify_one()) scheduler::wake(runner.get_ptr().get());
+                    }
+                }
+
+                // Starts the coroutine thread if it is not running yet. In interrupt context, this is deferred to a DPC.
+                static void start_runner()
+                {
+                    if (__builtin_expect(runner->is_running(), true)) return;
+                    if (dpmi::in_irq_context())
+                    {
+                        dpmi::interrupt_mask no_interrupts_please { };
+                        if (!runner_pending) runner_pending = queue_dpc([] { runner_pending = false; start_runner(); });
+                        return;
+                    }
+                    runner->start();
+                }
+
+                // Parks a coroutine until its condition is true, or its deadline has passed.
+                // Only called from the coroutine thread itself.
+                static void poll(co_promise_base* p, co_poll_node* n) noexcept
+                {
+                    p->poll = n;
+                    p->next = poll_list;
+                    poll_list = p;
+                }
+
+                // Called when a detached coroutine ends with an exception. Passes it on to the main thread, like an
+                // orphaned task.
+                static void orphaned_exception(std::exception_ptr e) noexcept
+                {
+                    try
+                    {
+                        try { std::rethrow_exception(e); }
+                        catch (...) { std::throw_with_nested(thread_exception { nullptr }); }
+                    }
+                    catch (...) { scheduler::deliver_exception(scheduler::main_thread.get(), std::current_exception()); }
+                }
+
+            private:
+                static void run()
+                {
+                    while (true)
+                    {
+                        co_promise_base* p;
+                        {
+                            dpmi::interrupt_mask no_interrupts_please { };
+                            p = ready_head;
+                            ready_head = ready_tail = nullptr;
+                        }
+                        while (p != nullptr)
+                        {
+                            auto* next = p->next;
+                            p->handle.resume();     // may destroy p
+                            p = next;
+                        }
+
+                        auto now = chrono::tsc::now();
+                        auto earliest = chrono::tsc::time_point::max();
+                        bool polling { false };
+                        for (auto** i = &poll_list; *i != nullptr; )
+                        {
+                            auto* q = *i;
+                            auto* n = q->poll;
+                            if ((n->ready != nullptr && n->ready(n)) || now >= n->deadline)
+                            {
+                                *i = q->next;
+                                q->poll = nullptr;
+                                schedule(q);
+                                continue;
+                            }
+                            if (n->ready != nullptr) polling = true;
+                            else earliest = std::min(earliest, n->deadline);
+                            i = &q->next;
+                        }
+
+                        if (ready_head == nullptr && poll_list == nullptr) waiters.wait();
+                        else
+                        {
+                            if (ready_head == nullptr && !polling) scheduler::sleep_for(earliest - chrono::tsc::now());
+                            yield();
+                        }
+                    }
+                }
+
+                inline static co_promise_base* ready_head { nullptr };
+                inline static co_promise_base* ready_tail { nullptr };
+                inline static co_promise_base* poll_list { nullptr };
+                inline static wait_queue waiters { };
+                inline static bool runner_pending { false };
+                inline static task<void()> runner { [] { run(); } };
+                inline static struct init { init() { runner->name = "Coroutine scheduler"; } } initializer { };
+            };
+
+            template<typename P>
+            std::coroutine_handle<> co_promise_base::final_awaiter::await_suspend(std::coroutine_handle<P> h) noexcept
+            {
+                auto& p = h.promise();
+                p.done = true;
+                p.awaiters.notify_all();
+                if (p.continuation) return p.continuation;
+                if (p.detached)
+                {
+                    if (p.exception) co_scheduler::orphaned_exception(p.exception);
+                    h.destroy();
+                }
+                return std::noop_coroutine();
+            }
+
+            template<typename F>
+            struct co_poll_awaiter : co_poll_node
+            {
+                F condition;
+                bool result { false };
+
+                co_poll_awaiter(F f, chrono::tsc::time_point t) : co_poll_node { &check, t }, condition(std::move(f)) { }
+
+                bool await_ready() { return (result = condition()) || chrono::tsc::now() >= deadline; }
+                template<typename P> void await_suspend(std::coroutine_handle<P> h) noexcept { co_scheduler::poll(&h.promise(), this); }
+                bool await_resume() const noexcept { return result; }
+
+                static bool check(co_poll_node* n) { auto* self = static_cast<co_poll_awaiter*>(n); return self->result = self->condition(); }
+            };
+
+            struct co_next_turn_awaiter
+            {
+                bool await_ready() const noexcept { return false; }
+                template<typename P> void await_suspend(std::coroutine_handle<P> h) noexcept { co_scheduler::schedule(&h.promise()); }
+                void await_resume() const noexcept { }
+            };
+
+            struct co_sleep_awaiter : co_poll_node
+            {
+                co_sleep_awaiter(chrono::tsc::time_point t) noexcept : co_poll_node { nullptr, t } { }
+
+                bool await_ready() const noexcept { return chrono::tsc::now() >= deadline; }
+                template<typename P> void await_suspend(std::coroutine_handle<P> h) noexcept { co_scheduler::poll(&h.promise(), this); }
+                void await_resume() const noexcept { }
+            };
+        }
+
+        // Stackless counterpart of task. Any function that returns co_task<R> and uses co_await or co_return is a
+        // coroutine. Its frame is allocated from a small locked pool (config::coroutine_frame_pool_size), instead of
+        // needing a whole stack. All coroutines run on one shared thread, so a coroutine must never block: use the
+        // co_ awaitables below instead of yield_while() and friends.
+        // A co_task does not run until it is started or awaited. If the co_task object is destroyed while its
+        // coroutine is still running, the coroutine is detached and finishes on its own.
+        template<typename R = void>
+        class co_task
+        {
+        public:
+            struct promise_type : detail::co_promise<R>
+            {
+                co_task get_return_object() noexcept
+                {
+                    auto h = std::coroutine_handle<promise_type>::from_promise(*this);
+                    this->handle = h;
+                    return co_task { h };
+                }
+            };
+
+            co_task(co_task&& other) noexcept : h(std::exchange(other.h, nullptr)) { }
+            co_task& operator=(co_task&& other) noexcept
+            {
+                release();
+                h = std::exchange(other.h, nullptr);
+                return *this;
+            }
+            co_task(const co_task&) = delete;
+            co_task& operator=(const co_task&) = delete;
+
+            ~co_task() { release(); }
+
+            // Schedules the coroutine to run on the coroutine thread. Safe in interrupt context.
+            // May throw if the coroutine thread can't be started.
+            void start()
+            {
+                auto& p = h.promise();
+                if (p.started) return;
+                p.started = true;
+                detail::co_scheduler::schedule(&p);
+                detail::co_scheduler::start_runner();
+            }
+
+            bool is_running() const noexcept { return h.promise().started && !h.promise().done; }
+            bool done() const noexcept { return h.promise().done; }
+
+            // Starts the coroutine if needed, and blocks until it returns a result.
+            // Only for use from regular threads. Inside a coroutine, use co_await instead.
+            // May rethrow unhandled exceptions!
+            R await()
+            {
+                dpmi::throw_if_irq();
+                start();
+                while (!done()) h.promise().awaiters.wait();
+                return h.promise().get();
+            }
+
+            // Awaiting a co_task from another coroutine starts it, and resumes the caller directly once it is done.
+            auto operator co_await() const noexcept
+            {
+                struct awaiter
+                {
+                    std::coroutine_handle<promise_type> h;
+
+                    bool await_ready() const noexcept { return h.promise().done; }
+                    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept
+                    {
+                        auto& p = h.promise();
+                        p.continuation = caller;
+                        if (p.started) return std::noop_coroutine();
+                        p.started = true;
+                        return h;
+                    }
+                    R await_resume() { return h.promise().get(); }
+                };
+                return awaiter { h };
+            }
+
+        private:
+            std::coroutine_handle<promise_type> h;
+
+            explicit co_task(std::coroutine_handle<promise_type> handle) noexcept : h(handle) { }
+
+            void release() noexcept
+            {
+                if (!h) return;
+                auto& p = h.promise();
+                if (!p.started || p.done) h.destroy();
+                else p.detached = true;
+                h = nullptr;
+            }
+        };
+
+        // Lets other coroutines and threads run, and resumes on the next pass.
+        inline auto co_next_turn() noexcept { return detail::co_next_turn_awaiter { }; }
+
+        // Suspends until the given time point.
+        inline auto co_sleep_until(chrono::tsc::time_point t) noexcept { return detail::co_sleep_awaiter { t }; }
+
+        // Suspends for the given duration.
+        inline auto co_sleep_for(chrono::tsc::duration d) noexcept { return co_sleep_until(chrono::tsc::now() + d); }
+
+        // Suspends until condition() is true, or until the time point has passed. Returns the last result of condition().
+        // The condition is checked once per pass, from the coroutine thread.
+        template<typename F>
+        inline auto co_poll(F condition, chrono::tsc::time_point timeout = chrono::tsc::time_point::max())
+        {
+            return detail::co_poll_awaiter<F> { std::move(condition), timeout };
+        }
+
+        // Suspends until there is input available on the stream, or until the time point has passed.
+        // Returns false on timeout.
+        inline auto co_readable(std::istream& s, chrono::tsc::time_point timeout = chrono::tsc::time_point::max())
+        {
+            return co_poll([&s] { return s.rdbuf()->in_avail() != 0; }, timeout);
+        }
+    }
+}
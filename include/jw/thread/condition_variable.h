@@ -0,0 +1,93 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <jw/thread/thread.h>
+#include <jw/chrono/chrono.h>
+
+namespace jw
+{
+    namespace thread
+    {
+        enum class cv_status { no_timeout, timeout };
+
+        // Works with any lockable type, like std::condition_variable_any.
+        // Threads in wait() are blocked until notified. Timed waits poll instead, so they are woken up by every
+        // notification, not just the ones meant for them. wait_for() measures time with chrono::tsc.
+        // Notifying is allowed in interrupt context.
+        class condition_variable
+        {
+            detail::wait_queue waiters;
+            std::atomic<std::uint32_t> generation { 0 };
+
+        public:
+            constexpr condition_variable() noexcept = default;
+            condition_variable(condition_variable&&) = delete;
+            condition_variable(const condition_variable&) = delete;
+
+            void notify_one() noexcept 
+            { 
+                ++generation;
+                waiters.notify_one(); 
+            }
+
+            void notify_all() noexcept 
+            { 
+                ++generation;
+                waiters.notify_all(); 
+            }
+
+            template<typename L> void wait(L& lock)
+            {
+                dpmi::throw_if_irq();
+                lock.unlock();
+                try { waiters.wait(); }
+                catch (...)
+                {
+                    lock.lock();
+                    throw;
+                }
+                lock.lock();
+            }
+
+            template<typename L, typename P> void wait(L& lock, P predicate)
+            {
+                while (!predicate()) wait(lock);
+            }
+
+            template<typename L, typename T> cv_status wait_until(L& lock, T time_point)
+            {
+                dpmi::throw_if_irq();
+                auto gen = generation.load();
+                lock.unlock();
+                try { yield_while_until([&] { return generation == gen; }, time_point); }
+                catch (...)
+                {
+                    lock.lock();
+                    throw;
+                }
+                lock.lock();
+                return generation == gen ? cv_status::timeout : cv_status::no_timeout;
+            }
+
+            template<typename L, typename T, typename P> bool wait_until(L& lock, T time_point, P predicate)
+            {
+                while (!predicate())
+                    if (wait_until(lock, time_point) == cv_status::timeout) return predicate();
+                return true;
+            }
+
+            template<typename L, typename R, typename P> cv_status wait_for(L& lock, std::chrono::duration<R, P> duration)
+            {
+                return wait_until(lock, chrono::tsc::now() + duration);
+            }
+
+            template<typename L, typename R, typename P, typename F> bool wait_for(L& lock, std::chrono::duration<R, P> duration, F predicate)
+            {
+                return wait_until(lock, chrono::tsc::now() + duration, predicate);
+            }
+        };
+    }
+}
@@ -31,23 +31,23 @@ namespace jw
             class coroutine_impl<R(A...), stack_bytes> : public task_base<stack_bytes>
             {
                 template<typename, std::size_t> friend class coroutine;
-                using function_sig = void(coroutine_impl<R(A...), stack_bytes>&, A...);
                 using base = task_base<stack_bytes>;
 
-                std::function<function_sig> function;
-                std::unique_ptr<std::tuple<A...>> arguments;
-                std::unique_ptr<R> result;
+                std::optional<std::tuple<A...>> arguments;
+                std::optional<R> result;
 
             protected:
+                virtual void invoke(A&&... args) = 0;
+
                 virtual void call() override { call(std::index_sequence_for<A...>()); }
-                template <std::size_t... i> void call(std::index_sequence<i...>) { function(*this, std::get<i>(std::move(*arguments))...); }
+                template <std::size_t... i> void call(std::index_sequence<i...>) { invoke(std::get<i>(std::move(*arguments))...); }
 
             public:
                 // Start the coroutine thread using the specified arguments.
                 constexpr void start(A... args)
                 {
                     if (this->is_running()) return; // or throw...?
-                    arguments = std::make_unique<std::tuple<A...>>(std::forward<A>(args)...);
+                    arguments.emplace(std::forward<A>(args)...);
                     result.reset();
                     base::start();
                 }
@@ -74,7 +74,7 @@ namespace jw
                 {
                     if (!try_await()) throw illegal_await(this->shared_from_this());
 
-                    this->state = running;
+                    this->resume();
                     return std::move(*result);
                 }
 
@@ -84,13 +84,28 @@ namespace jw
                 {
                     if (!scheduler::is_current_thread(this)) return; // or throw?
 
-                    result = std::make_unique<R>(std::move(value));
+                    result.emplace(std::move(value));
                     this->state = suspended;
                     ::jw::thread::yield();
                     result.reset();
                 }
+            };
+
+            // Stores the function inline, as task_function does for tasks.
+            template<typename F, typename sig, std::size_t stack_bytes>
+            class coroutine_function;
+
+            template<typename F, typename R, typename... A, std::size_t stack_bytes>
+            class coroutine_function<F, R(A...), stack_bytes> final : public coroutine_impl<R(A...), stack_bytes>
+            {
+                F function;
 
-                coroutine_impl(std::function<function_sig> f) : function(f) { }
+            protected:
+                virtual void invoke(A&&... args) override { function(static_cast<coroutine_impl<R(A...), stack_bytes>&>(*this), std::forward<A>(args)...); }
+
+            public:
+                template<typename G>
+                coroutine_function(G&& f) : function(std::forward<G>(f)) { }
             };
         }
 
@@ -101,6 +116,7 @@ namespace jw
         class coroutine<R(A...), stack_bytes>
         {
             using task_type = detail::coroutine_impl<R(A...), stack_bytes>;
+            template<typename F> using function_type = detail::coroutine_function<std::decay_t<F>, R(A...), stack_bytes>;
             std::shared_ptr<task_type> ptr;
 
         public:
@@ -110,7 +126,11 @@ namespace jw
             constexpr operator bool() const { return ptr.operator bool(); }
 
             template<typename F>
-            constexpr coroutine(F&& f) : ptr(std::make_shared<task_type>(std::forward<F>(f))) { }
+            constexpr coroutine(F&& f) : ptr(std::make_shared<function_type<F>>(std::forward<F>(f))) { }
+
+            // Allocates the coroutine with the given allocator. The thread stack is allocated separately.
+            template<typename F, typename Alloc>
+            constexpr coroutine(std::allocator_arg_t, Alloc&& a, F&& f) : ptr(std::allocate_shared<function_type<F>>(std::forward<Alloc>(a), std::forward<F>(f))) { }
 
             constexpr coroutine(const coroutine&) = default;
             constexpr coroutine() = default;
@@ -0,0 +1,43 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
+
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <jw/thread/detail/thread.h>
+
+namespace jw
+{
+    namespace thread
+    {
+        struct thread_cpu_usage
+        {
+            std::uint32_t id;
+            std::string name;
+            std::uint32_t priority;
+            detail::thread_state state;
+            std::uint64_t cycles;
+        };
+
+        // Snapshot of where the cpu time has gone, in TSC cycles. Requires config::enable_thread_cpu_time.
+        // Idle time is time spent in the main thread when it was woken up only because nothing else could run.
+        // Interrupt handlers are counted separately, and not charged to the thread they interrupted.
+        struct cpu_usage
+        {
+            std::uint64_t total_cycles;
+            std::uint64_t idle_cycles;
+            std::uint64_t irq_cycles;
+            std::vector<thread_cpu_usage> threads;      // busiest thread first
+
+            // Returns the usage in the interval between an earlier snapshot and this one.
+            cpu_usage since(const cpu_usage& earlier) const;
+        };
+
+        cpu_usage get_cpu_usage();
+
+        // Prints a table of threads sorted by cpu usage, like "top".
+        std::ostream& operator<<(std::ostream& out, const cpu_usage& u);
+    }
+}
@@ -4,52 +4,188 @@
 
 #pragma once
 #include <iostream>
+#include <array>
+#include <chrono>
 #include <functional>
 #include <memory>
-#include <deque> 
 #include <jw/thread/detail/thread.h>
 #include <jw/dpmi/irq_check.h>
-#include <jw/dpmi/alloc.h>
+#include <jw/dpmi/irq_mask.h>
+#include <jw/dpmi/debug.h>
 
 // TODO: task->delayed_start(), to schedule a task without immediately starting it.
-// TODO: make errno thread-local? other globals?
 
 int main(int, char**);
 
 namespace jw
 {
+    namespace chrono { struct chrono; }
+
     namespace thread
     {
         void yield();
+        struct cpu_usage;
+        cpu_usage get_cpu_usage();
 
         namespace detail
         {
             class scheduler
             {
                 template<std::size_t> friend class task_base;
+                friend class thread;
                 friend void ::jw::thread::yield();
+                friend cpu_usage (::jw::thread::get_cpu_usage)();
                 friend int ::main(int, char**);
-                static dpmi::locked_pool_allocator<> alloc;
-                static std::deque<thread_ptr, dpmi::locked_pool_allocator<>> threads;
-                static thread_ptr current_thread;
+                friend struct ::jw::chrono::chrono;
+                friend class wait_queue;
+                friend struct co_scheduler;
+
+                // Threads that are ready to run, one list per priority level. The current thread is not in any list.
+                static std::array<thread_list, thread::max_priority + 1> ready_list;
+                // One bit for each non-empty ready_list.
+                static std::uint32_t ready_mask;
+                // Suspended threads. These are skipped until resumed, or until they receive an exception.
+                static thread_list suspended_list;
+                // Sleeping threads, sorted by wake_tick. Woken up by timer_tick(), which is called from the PIT interrupt.
+                static thread_list sleep_list;
+                // Threads blocked on a wait_queue. Each is also linked in the queue it is waiting on.
+                static thread_list blocked_list;
+                // Threads started from an interrupt handler while the stack pool was empty. These get a stack on the
+                // next thread switch.
+                static thread_list starting_list;
+                static volatile std::uint64_t ticks;
+                static double ns_per_tick;      // zero if there is no timer interrupt
+                static thread* current_thread;
                 static thread_ptr main_thread;
+                static thread_ptr finished_thread;     // released after switching away from it
+                // CPU time accounting, see config::enable_thread_cpu_time.
+                static std::uint64_t start_tsc;
+                static std::uint64_t last_switch_tsc;
+                static std::uint64_t last_interrupt_cycles;  // dpmi::detail::interrupt_cycles at the last thread switch
+                static std::uint64_t idle_cycles;
+                static bool idling;                         // main thread was woken up because nothing else could run
 
             public:
-                static bool is_current_thread(const thread* t) noexcept { return current_thread.get() == t; }
-                static std::weak_ptr<thread> get_current_thread() noexcept { return current_thread; }
+                static bool is_current_thread(const thread* t) noexcept { return current_thread == t; }
+                // True while deferred procedure calls are running. Threads started here are not switched to.
+                static bool in_dpc() noexcept;
+                static std::weak_ptr<thread> get_current_thread() noexcept { return current_thread->self; }
                 static auto& get_current_thread_id() noexcept { return current_thread->id(); }
-                static const auto& get_threads() { return threads; }
+
+                // Calls f(const thread_ptr&) for each thread, except the current one.
+                template<typename F>
+                static void for_each_thread(F&& f)
+                {
+                    dpmi::interrupt_mask no_interrupts_please { };
+                    auto each = [&f](const thread_list& l) { for (auto* t = l.front(); t != nullptr; t = thread_list::next(t)) f(t->self); };
+                    for (auto& l : ready_list) each(l);
+                    each(suspended_list);
+                    each(sleep_list);
+                    each(blocked_list);
+                    each(starting_list);
+                }
+
+                // Parks the current thread for approximately the given duration. This wakes up one tick early, or
+                // doesn't sleep at all if there is no timer, so the caller must still poll its clock afterwards.
+                template<typename Rep, typename Period>
+                static void sleep_for(std::chrono::duration<Rep, Period> d)
+                {
+                    sleep_ns(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+                }
+
+                // Raises the effective priority of t to that of the current thread. Used by mutexes to lend
+                // priority to the owner of a lock, while a higher-priority thread is waiting for it.
+                static void inherit_priority(thread* t) noexcept
+                {
+                    if (t->priority < current_thread->priority) set_effective_priority(t, current_thread->priority);
+                }
+
+                static bool handle_guard_page_fault(std::uintptr_t linear_address) noexcept;
+
+                // Adds a lock to the current thread's held_locks.
+                static void acquire_lock(priority_lock* l) noexcept;
+
+                // Removes a lock from the current thread's held_locks, and lowers its effective priority to that of
+                // the highest-priority thread still waiting on one of the other locks it holds.
+                static void release_lock(priority_lock* l) noexcept;
 
             private:
                 [[gnu::noinline, gnu::noclone, gnu::no_stack_limit]] static void context_switch() noexcept;
                 static void thread_switch(thread_ptr = nullptr);
                 [[gnu::noinline]] static void set_next_thread() noexcept;
+#ifdef __x86_64__
+                struct next_context { thread_context* context; void (*entry)() noexcept; };
+                static next_context switch_context(thread_context* current) noexcept;
+#endif
                 static void check_exception();
+                static void deliver_exception(thread* t, std::exception_ptr e);
+                static void add_exception(std::exception_ptr e);
+                static bool exception_pending(const thread* t) noexcept { return t->pending_exceptions() != 0 || (t->awaiting && t->awaiting->pending_exceptions() != 0); }
+                static void set_suspended(thread* t, bool s) noexcept;
+                static void set_effective_priority(thread* t, std::uint32_t p) noexcept;
+                static void push_ready(thread* t, bool front = false) noexcept;
+                static thread* pop_ready() noexcept;
+                static void unlink(thread* t) noexcept;
+                static bool is_ready(const thread* t) noexcept { return t->list >= ready_list.begin() && t->list < ready_list.end(); }
+                static void wake(thread* t) noexcept;
+                static void unpark(thread* t) noexcept;
+                static void sleep_ns(std::int64_t ns);
+                static void block(wait_queue* q);
+                static bool take_stack(thread* t) noexcept;
+                static void allocate_stack(thread* t);
+                static void allocate_pending_stacks();
+                static void release_stack(thread* t) noexcept;
+                static void release_finished_thread() noexcept;
+                static void run_dpcs() noexcept;
+                static void destroy_thread_locals() noexcept;
+                static std::uint64_t running_cycles() noexcept;
+                static void account_cycles(thread* t) noexcept;
+
+                // Called from the chrono interface, to drive sleep_for().
+                static void set_timer(double ns) noexcept;
+                static void timer_tick() noexcept;
 
-                [[gnu::used]] static void run_thread() noexcept;
+                [[gnu::used, noreturn]] static void run_thread() noexcept;
 
                 struct init_main { init_main(); } static initializer;
             };
+
+            // Queue of threads that are blocked on a synchronization object. Blocked threads are not scheduled at all
+            // until they are notified. Notifying is allowed in interrupt context.
+            class wait_queue
+            {
+                friend class scheduler;
+                thread* head { nullptr };
+                thread* tail { nullptr };
+                bool missed { false };      // notified from an interrupt while no thread was waiting yet
+
+                void push_back(thread* t) noexcept;
+                void erase(thread* t) noexcept;
+
+            public:
+                constexpr wait_queue() noexcept = default;
+                wait_queue(wait_queue&&) = delete;
+                wait_queue(const wait_queue&) = delete;
+
+                bool empty() const noexcept { return head == nullptr; }
+
+                // Blocks the current thread until it is notified. Also returns when the thread is switched to
+                // directly, is aborted or receives an exception, so always check the condition again.
+                void wait() { scheduler::block(this); }
+
+                // Wakes up the waiting thread with the highest priority. Returns false if there was none.
+                bool notify_one() noexcept;
+
+                void notify_all() noexcept;
+            };
+
+            // Base for mutexes with priority inheritance. While a thread holds one, it is linked in that thread's
+            // held_locks, so its priority can be recomputed from the waiters of the locks it still holds.
+            struct priority_lock
+            {
+                wait_queue waiters;
+                priority_lock* next_held { nullptr };
+            };
         }
     }
 }
@@ -6,15 +6,32 @@
 #include <functional>
 #include <memory>
 #include <deque>
+#include <chrono>
 #include <iostream>
 #include <jw/common.h>
 
 namespace jw
 {
+    namespace dpmi { struct memory_base; class fpu_context; }
+
     namespace thread
     {
         namespace detail
         {
+#ifdef __x86_64__
+            // Host build, see the x86-64 variant of scheduler::context_switch().
+            struct thread_context
+            {
+                std::uint64_t r15;
+                std::uint64_t r14;
+                std::uint64_t r13;
+                std::uint64_t r12;
+                std::uint64_t rbx;
+                std::uint64_t rbp;
+                // All other registers are caller-saved.
+                // rsp is the pointer to this struct.
+            };
+#else
             struct[[gnu::packed]] thread_context
             {
                 std::uint32_t gs;
@@ -28,6 +45,7 @@ namespace jw
                 // cs, ds, ss (should) never change.
                 // esp is the pointer to this struct.
             };
+#endif
 
             enum thread_state
             {
@@ -39,23 +57,51 @@ namespace jw
                 finished
             };
 
+            class thread;
+            struct thread_list;
+            class wait_queue;
+            struct priority_lock;
+            using thread_ptr = std::shared_ptr<thread>;
+
             // Base class for all threads.
             class thread
             {
                 friend class scheduler;
                 template<std::size_t> friend class task_base;
                 friend class thread_details;
+                friend struct thread_list;
+                friend class wait_queue;
 
                 static std::uint32_t id_count;
 
                 thread_context* context; // points to esp during context switch
-                const std::size_t stack_size;
-                byte* const stack_ptr;
+                std::size_t stack_size;
+                byte* stack_ptr { nullptr };     // taken from the scheduler's stack pool while the thread is running
+                dpmi::memory_base* stack_block { nullptr };     // DPMI memory block, if the stack has a guard page
+                bool stack_overflowed { false };                // guard page was hit and is now committed
+                dpmi::fpu_context* fpu_state { nullptr };       // saved x87/SSE state, allocated on first use
                 std::deque<std::exception_ptr> exceptions { };
                 const std::uint32_t id_num;
                 std::uint32_t trap_masked { 0 };
                 bool trap { false };
 
+                // Scheduler bookkeeping. While a thread is running, the scheduler holds a reference to it in self,
+                // and it is linked in one of the scheduler's thread_lists, unless it is the current thread.
+                thread_ptr self;
+                thread_list* list { nullptr };
+                thread* next { nullptr };
+                thread* prev { nullptr };
+                std::uint32_t base_priority { default_priority };
+                std::uint32_t priority { default_priority };    // effective priority, raised by priority inheritance
+                std::uint64_t wake_tick { 0 };                  // timer tick to wake up at, while sleeping
+                wait_queue* waiting { nullptr };                // queue this thread is blocked on
+                thread* wait_next { nullptr };
+                thread* wait_prev { nullptr };
+                priority_lock* held_locks { nullptr };          // locks with priority inheritance held by this thread
+                std::uint64_t cycles { 0 };                     // TSC cycles spent running, up to the last thread switch
+                void** tls { nullptr };                         // thread_local_ptr slots, at the top of the stack
+                int saved_errno { 0 };
+
             protected:
                 thread_state state { initialized };
                 std::shared_ptr<thread> parent;
@@ -66,14 +112,10 @@ namespace jw
                 auto& operator=(const thread&) = delete;
                 thread(const thread&) = delete;
 
-                thread(std::size_t bytes, byte* ptr) : stack_size(bytes), stack_ptr(ptr), id_num(++id_count) { }
+                thread(std::size_t bytes) : stack_size(bytes), id_num(++id_count) { }
 
             public:
-                virtual void abort(bool = true)
-                {
-                    if (!this->is_running()) return;
-                    this->state = terminating;
-                }
+                virtual void abort(bool = true);
 
                 bool is_running() const noexcept { return (state != initialized && state != finished); }
                 auto pending_exceptions() const noexcept { return __builtin_expect(exceptions.size(), 0); }
@@ -82,8 +124,21 @@ namespace jw
                 std::string name { "anonymous thread" };
                 bool allow_orphan { false };
 
-                void suspend() noexcept { if (state == running) state = suspended; }
-                void resume() noexcept { if (state == suspended) state = running; }
+                void suspend() noexcept;
+                void resume() noexcept;
+
+                // Threads with a higher priority always run first. Threads of equal priority run in turn.
+                // A high-priority thread that never waits on anything will starve all threads below it.
+                static constexpr std::uint32_t idle_priority { 0 };
+                static constexpr std::uint32_t default_priority { 4 };
+                static constexpr std::uint32_t max_priority { 7 };
+                void set_priority(std::uint32_t p) noexcept;
+                auto get_priority() const noexcept { return base_priority; }
+
+                // Time spent running this thread, not counting interrupt handlers. Requires
+                // config::enable_thread_cpu_time. cpu_time() also requires a calibrated TSC, see chrono::setup_tsc().
+                std::uint64_t cpu_cycles() const noexcept;
+                std::chrono::nanoseconds cpu_time() const noexcept;
                 
                 virtual ~thread()
                 {
@@ -111,7 +166,66 @@ namespace jw
             #endif
             };
 
-            using thread_ptr = std::shared_ptr<thread>;
+            // Intrusive doubly-linked list of threads. Does not own its elements.
+            struct thread_list
+            {
+                bool empty() const noexcept { return head == nullptr; }
+                thread* front() const noexcept { return head; }
+                static thread* next(const thread* t) noexcept { return t->next; }
+
+                void push_back(thread* t) noexcept
+                {
+                    t->list = this;
+                    t->next = nullptr;
+                    t->prev = tail;
+                    if (tail != nullptr) tail->next = t;
+                    else head = t;
+                    tail = t;
+                }
+
+                void push_front(thread* t) noexcept
+                {
+                    t->list = this;
+                    t->prev = nullptr;
+                    t->next = head;
+                    if (head != nullptr) head->prev = t;
+                    else tail = t;
+                    head = t;
+                }
+
+                // Inserts t before pos, or at the back if pos is nullptr.
+                void insert(thread* pos, thread* t) noexcept
+                {
+                    if (pos == nullptr) return push_back(t);
+                    if (pos == head) return push_front(t);
+                    t->list = this;
+                    t->next = pos;
+                    t->prev = pos->prev;
+                    pos->prev->next = t;
+                    pos->prev = t;
+                }
+
+                void erase(thread* t) noexcept
+                {
+                    if (t->prev != nullptr) t->prev->next = t->next;
+                    else head = t->next;
+                    if (t->next != nullptr) t->next->prev = t->prev;
+                    else tail = t->prev;
+                    t->list = nullptr;
+                    t->next = t->prev = nullptr;
+                }
+
+                thread* pop_front() noexcept
+                {
+                    auto* t = head;
+                    erase(t);
+                    return t;
+                }
+
+            private:
+                thread* head { nullptr };
+                thread* tail { nullptr };
+            };
         }
     }
 }
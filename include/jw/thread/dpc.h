@@ -0,0 +1,50 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
+
+#pragma once
+#include <type_traits>
+#include <new>
+#include <jw/spsc_ring.h>
+#include <jw/dpmi/irq_mask.h>
+#include <../jwdpmi_config.h>
+
+namespace jw
+{
+    namespace thread
+    {
+        namespace detail
+        {
+            // Deferred procedure call. Holds a small trivially-copyable callable, such as a lambda capturing 'this'.
+            struct dpc
+            {
+                static constexpr std::size_t max_size { 3 * sizeof(void*) };
+
+                void (*call)(const dpc*);
+                std::aligned_storage_t<max_size, alignof(void*)> storage;
+            };
+
+            using dpc_queue_type = spsc_ring<dpc, config::dpc_queue_size>;
+            extern dpc_queue_type* dpc_queue;
+        }
+
+        // Queues f to be called in thread context, at the next thread switch, before any other thread runs.
+        // This is the way for interrupt handlers to defer work that may not be done in interrupt context, or that
+        // takes too long. Returns false if the queue is full (see config::dpc_queue_size).
+        // A DPC runs on the stack of whichever thread happens to yield, so it should be short. It can not yield:
+        // yield() returns immediately, and a thread started from a DPC is only made ready, with the main thread as
+        // its parent, as if it was started from an interrupt. Exceptions are passed on to the main thread.
+        template<typename F>
+        bool queue_dpc(F f) noexcept
+        {
+            static_assert(std::is_trivially_copyable_v<F> && sizeof(F) <= detail::dpc::max_size && alignof(F) <= alignof(void*),
+                "DPC function must be small and trivially copyable.");
+            detail::dpc d;
+            d.call = [](const detail::dpc* p) { (*reinterpret_cast<const F*>(&p->storage))(); };
+            new (&d.storage) F { f };
+            auto* q = detail::dpc_queue;
+            if (__builtin_expect(q == nullptr, false)) return false;
+            dpmi::interrupt_mask no_interrupts_please { };    // interrupts may nest, so only one producer at a time
+            return q->push_back(d);
+        }
+    }
+}
@@ -25,9 +25,12 @@ namespace jw
 {
     namespace thread
     {
-        class mutex
+        // Threads waiting in lock() are blocked until the mutex is unlocked, and only one of them is woken up then.
+        // While a thread is waiting, the owner inherits its priority until it calls unlock().
+        class mutex : detail::priority_lock
         {
             std::atomic_flag locked { false };
+            std::weak_ptr<detail::thread> owner;
         public:
             constexpr mutex() noexcept = default;
             mutex(mutex&&) = delete;
@@ -36,13 +39,31 @@ namespace jw
             void lock() 
             { 
                 dpmi::throw_if_irq(); 
-                yield_while([&]() { return !try_lock(); }); 
+                while (!try_lock())
+                {
+                    if (auto t = owner.lock()) detail::scheduler::inherit_priority(t.get());
+                    try { waiters.wait(); }
+                    catch (...)
+                    {
+                        waiters.notify_one();   // we may have been woken by unlock(), pass it on
+                        throw;
+                    }
+                }
+            }
+            void unlock() noexcept
+            {
+                owner.reset();
+                detail::scheduler::release_lock(this);
+                locked.clear();
+                waiters.notify_one();
             }
-            void unlock() noexcept { locked.clear(); }
             bool try_lock() noexcept 
             { 
                 if (dpmi::in_irq_context()) return false;
-                return !locked.test_and_set(); 
+                if (locked.test_and_set()) return false;
+                owner = detail::scheduler::get_current_thread();
+                detail::scheduler::acquire_lock(this);
+                return true;
             }
         };
 
@@ -50,6 +71,7 @@ namespace jw
         {
             std::atomic_flag locked { false };
             std::atomic<std::uint32_t> shared_count { 0 };
+            detail::wait_queue waiters;
 
         public:
             constexpr shared_mutex() noexcept = default;
@@ -59,38 +81,45 @@ namespace jw
             void lock() 
             { 
                 dpmi::throw_if_irq(); 
-                yield_while([&]() { return !try_lock(); }); 
+                while (!try_lock()) waiters.wait();
+            }
+            void unlock() noexcept
+            {
+                locked.clear();
+                waiters.notify_all();
             }
-            void unlock() noexcept { locked.clear(); }
             bool try_lock() noexcept
             {
                 if (dpmi::in_irq_context()) return false;
                 if (locked.test_and_set()) return false;
                 if (shared_count == 0) return true;
-                unlock();
+                locked.clear();
                 return false;
             }
 
             void lock_shared() 
             { 
                 dpmi::throw_if_irq(); 
-                yield_while([&]() { return !try_lock_shared(); }); 
+                while (!try_lock_shared()) waiters.wait();
+            }
+            void unlock_shared() noexcept 
+            { 
+                if (--shared_count == 0) waiters.notify_all();
             }
-            void unlock_shared() noexcept { --shared_count; }
             bool try_lock_shared() noexcept
             {
                 if (dpmi::in_irq_context()) return false;
                 if (locked.test_and_set()) return false;
                 ++shared_count;
-                unlock();
+                locked.clear();
                 return true;
             }
         };
 
-        class recursive_mutex
+        class recursive_mutex : detail::priority_lock
         {
             std::atomic<std::uint32_t> lock_count { 0 };
-            std::weak_ptr<const detail::thread> owner;
+            std::weak_ptr<detail::thread> owner;
 
         public:
             constexpr recursive_mutex() noexcept = default;
@@ -100,12 +129,24 @@ namespace jw
             void lock() 
             { 
                 dpmi::throw_if_irq(); 
-                yield_while([&]() { return !try_lock(); }); 
+                while (!try_lock())
+                {
+                    if (auto t = owner.lock()) detail::scheduler::inherit_priority(t.get());
+                    try { waiters.wait(); }
+                    catch (...)
+                    {
+                        waiters.notify_one();   // we may have been woken by unlock(), pass it on
+                        throw;
+                    }
+                }
             }
             void unlock() noexcept
             {
                 if (detail::scheduler::is_current_thread(owner.lock().get())) --lock_count;
-                if (lock_count == 0) owner.reset();
+                if (lock_count > 0) return;
+                owner.reset();
+                detail::scheduler::release_lock(this);
+                waiters.notify_one();
             }
             bool try_lock() noexcept
             {
@@ -114,6 +155,7 @@ namespace jw
                 {
                     owner = detail::scheduler::get_current_thread();
                     lock_count = 1;
+                    detail::scheduler::acquire_lock(this);
                     return true;
                 }
                 else if (detail::scheduler::is_current_thread(owner.lock().get()))
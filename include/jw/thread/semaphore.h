@@ -0,0 +1,46 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
+
+#pragma once
+#include <atomic>
+#include <jw/thread/thread.h>
+
+namespace jw
+{
+    namespace thread
+    {
+        // Counting semaphore. Threads in acquire() are blocked until a count is available.
+        // release() and try_acquire() may be called from interrupt context, eg. to wake up a thread from an IRQ handler.
+        class semaphore
+        {
+            std::atomic<std::uint32_t> count;
+            detail::wait_queue waiters;
+
+        public:
+            constexpr semaphore(std::uint32_t initial = 0) noexcept : count(initial) { }
+            semaphore(semaphore&&) = delete;
+            semaphore(const semaphore&) = delete;
+
+            void acquire()
+            {
+                dpmi::throw_if_irq();
+                while (!try_acquire()) waiters.wait();
+            }
+
+            bool try_acquire() noexcept
+            {
+                auto c = count.load();
+                while (c > 0 && !count.compare_exchange_weak(c, c - 1)) { }
+                return c > 0;
+            }
+
+            void release(std::uint32_t n = 1) noexcept
+            {
+                count += n;
+                while (n-- > 0 && waiters.notify_one()) { }
+            }
+
+            std::uint32_t available() const noexcept { return count; }
+        };
+    }
+}
@@ -16,9 +16,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #pragma once
+#include <optional>
 #include <jw/thread/detail/thread.h>
 #include <jw/thread/detail/scheduler.h>
 #include <jw/thread/thread.h>
+#include <jw/thread/trace.h>
 #include <../jwdpmi_config.h>
 
 namespace jw
@@ -30,18 +32,17 @@ namespace jw
             template<std::size_t stack_bytes>
             class task_base : public detail::thread, public std::enable_shared_from_this<task_base<stack_bytes>>
             {
-                alignas(0x10) std::array<byte, stack_bytes> stack;
-
             protected:
-                constexpr task_base() : thread(stack_bytes, stack.data()) { }
+                constexpr task_base() : thread(stack_bytes) { }
 
                 constexpr void start()
                 {
                     if (this->is_running()) return;
 
                     this->state = starting;
-                    this->parent = scheduler::current_thread;
-                    if (dpmi::in_irq_context()) this->parent = scheduler::main_thread;
+                    trace(trace_event_type::start, this->id());
+                    this->parent = scheduler::current_thread->self;
+                    if (dpmi::in_irq_context() || scheduler::in_dpc()) this->parent = scheduler::main_thread;
                     scheduler::thread_switch(this->shared_from_this());
                 }
 
@@ -83,15 +84,18 @@ namespace jw
                             try { std::rethrow_exception(e); }
                             catch (...) { std::throw_with_nested(thread_exception { nullptr }); }
                         }
-                        catch (...) { parent->exceptions.push_back(std::current_exception()); }
+                        catch (...) { scheduler::deliver_exception(parent.get(), std::current_exception()); }
                     }
                     exceptions.clear();
+                    if (stack_ptr != nullptr) scheduler::release_stack(this);
                 }
             };
 
             template<typename sig, std::size_t stack_bytes>
             class task_impl;
 
+            // Arguments and result are stored inline, and the function is stored in task_function, which is
+            // allocated together with the shared_ptr control block. Starting a task does not allocate any memory.
             template<typename R, typename... A, std::size_t stack_bytes>
             class task_impl<R(A...), stack_bytes> : public task_base<stack_bytes>
             {
@@ -99,15 +103,15 @@ namespace jw
                 using base = task_base<stack_bytes>;
 
             protected:
-                std::function<R(A...)> function;
-                std::unique_ptr<std::tuple<A...>> arguments;
-                std::unique_ptr<typename std::conditional<std::is_void<R>::value, int, R>::type> result; // std::experimental::optional ?
+                std::optional<std::tuple<A...>> arguments;
+                std::optional<typename std::conditional<std::is_void<R>::value, int, R>::type> result;
+
+                virtual R invoke(A&&... args) = 0;
 
-                // std::experimental::apply ?
                 virtual void call() override { call(std::is_void<R>(), std::index_sequence_for<A...>()); }                                          // Determine if R is void
                 template <std::size_t... i> void call(std::true_type, std::index_sequence<i...> seq) { call(seq); }                                 // Void, discard non-existent result.
-                template <std::size_t... i> void call(std::false_type, std::index_sequence<i...> seq) { result = std::make_unique<R>(call(seq)); }  // Not void, save result.
-                template <std::size_t... i> auto call(std::index_sequence<i...>) { return function(std::get<i>(std::move(*arguments))...); }
+                template <std::size_t... i> void call(std::false_type, std::index_sequence<i...> seq) { result.emplace(call(seq)); }               // Not void, save result.
+                template <std::size_t... i> decltype(auto) call(std::index_sequence<i...>) { return invoke(std::get<i>(std::move(*arguments))...); }
 
                 auto get_result(std::true_type) { }
                 auto get_result(std::false_type) { return std::move(*result); }
@@ -117,7 +121,7 @@ namespace jw
                 constexpr void start(A... args)
                 {
                     if (this->is_running()) return;
-                    arguments = std::make_unique<std::tuple<A...>>(std::forward<A>(args)...);
+                    arguments.emplace(std::forward<A>(args)...);
                     result.reset();
                     base::start();
                 }
@@ -147,7 +151,26 @@ namespace jw
                     return get_result(std::is_void<R> { });
                 }
 
-                task_impl(std::function<R(A...)> f) : function(f) { }   // TODO: allocator support!
+            };
+
+            template<typename F, typename sig, std::size_t stack_bytes>
+            class task_function;
+
+            template<typename F, typename R, typename... A, std::size_t stack_bytes>
+            class task_function<F, R(A...), stack_bytes> final : public task_impl<R(A...), stack_bytes>
+            {
+                F function;
+
+            protected:
+                virtual R invoke(A&&... args) override
+                {
+                    if constexpr (std::is_void<R>::value) function(std::forward<A>(args)...);
+                    else return function(std::forward<A>(args)...);
+                }
+
+            public:
+                template<typename G>
+                task_function(G&& f) : function(std::forward<G>(f)) { }
             };
         }
 
@@ -158,6 +181,7 @@ namespace jw
         class task<R(A...), stack_bytes>
         {
             using task_type = detail::task_impl<R(A...), stack_bytes>;
+            template<typename F> using function_type = detail::task_function<std::decay_t<F>, R(A...), stack_bytes>;
             std::shared_ptr<task_type> ptr;
 
         public:
@@ -167,10 +191,11 @@ namespace jw
             constexpr operator bool() const { return ptr.operator bool(); }
 
             template<typename F>
-            constexpr task(F&& f) : ptr(std::make_shared<task_type>(std::forward<F>(f))) { }
+            constexpr task(F&& f) : ptr(std::make_shared<function_type<F>>(std::forward<F>(f))) { }
             
+            // Allocates the task with the given allocator. The thread stack is allocated separately.
             template<typename F, typename Alloc>
-            constexpr task(std::allocator_arg_t, Alloc&& a, F&& f) : ptr(std::allocate_shared<task_type>(std::forward<Alloc>(a), std::forward<F>(f))) { }
+            constexpr task(std::allocator_arg_t, Alloc&& a, F&& f) : ptr(std::allocate_shared<function_type<F>>(std::forward<Alloc>(a), std::forward<F>(f))) { }
 
             constexpr task(const task&) = default;
             constexpr task() = default;
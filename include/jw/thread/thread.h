@@ -24,6 +24,13 @@ namespace jw
             virtual const char* what() const noexcept override { return "Task orphaned, aborting."; }
         };
 
+        // Thrown on a thread that ran out of stack space.
+        // With a guard page, this is thrown as soon as it happens. Otherwise, it is detected on the next thread switch.
+        struct stack_overflow : public std::runtime_error
+        {
+            stack_overflow() : std::runtime_error("Stack overflow.") { }
+        };
+
         // Thrown when task->await() is called while no result will ever be available.
         struct illegal_await : public std::exception
         {
@@ -53,7 +60,7 @@ namespace jw
             thread_exception(const detail::thread_ptr& t) noexcept : thread(t) { }
         };
 
-        // Yields execution to the next thread in the queue.
+        // Yields execution to the next thread in the queue, starting with the highest priority.
         inline void yield() 
         { 
             if (dpmi::in_irq_context()) return;
@@ -70,10 +77,12 @@ namespace jw
         };
 
         // Yields execution until the given time point.
+        // If the PIT interrupt is enabled, the thread is not scheduled again until shortly before it is due.
         template<typename T> inline void yield_until(T time_point)
         { 
             if (dpmi::in_irq_context()) return;
             dpmi::trap_mask dont_trace_here { };
+            detail::scheduler::sleep_for(time_point - T::clock::now());
             yield_while([&time_point] { return T::clock::now() < time_point; });
         };
 
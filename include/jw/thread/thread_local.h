@@ -0,0 +1,59 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
+
+#pragma once
+#include <cstddef>
+#include <../jwdpmi_config.h>
+
+namespace jw
+{
+    namespace thread
+    {
+        namespace detail
+        {
+            // Slot table of the current thread, swapped by the scheduler on every thread switch. Each thread's
+            // table is stored at the top of its stack.
+            extern void** current_tls;
+
+            // Reserves a slot in every thread's table. dtor is called on each thread's value when that thread
+            // finishes. Throws std::length_error if all config::thread_local_slots are in use.
+            std::size_t allocate_tls_slot(void (*dtor)(void*));
+        }
+
+        // Pointer to a separate instance of T for each thread, created on first use. This is the equivalent of the
+        // thread_local keyword, which does not work with this scheduler. Lookup is a single indexed load.
+        // Meant for objects with static storage duration: slots are never reused. Do not use from interrupt handlers.
+        template<typename T>
+        class thread_local_ptr
+        {
+            const std::size_t slot;
+
+        public:
+            thread_local_ptr() : slot(detail::allocate_tls_slot([](void* p) { delete static_cast<T*>(p); })) { }
+            thread_local_ptr(const thread_local_ptr&) = delete;
+            thread_local_ptr& operator=(const thread_local_ptr&) = delete;
+
+            // Returns this thread's instance, and default-constructs it if there is none yet.
+            T* get()
+            {
+                auto*& p = detail::current_tls[slot];
+                if (__builtin_expect(p == nullptr, false)) p = new T { };
+                return static_cast<T*>(p);
+            }
+
+            // Returns this thread's instance, or nullptr if it has not been used on this thread yet.
+            T* try_get() const noexcept { return static_cast<T*>(detail::current_tls[slot]); }
+
+            // Destroys this thread's instance.
+            void reset()
+            {
+                auto* p = static_cast<T*>(detail::current_tls[slot]);
+                detail::current_tls[slot] = nullptr;
+                delete p;
+            }
+
+            T* operator->() { return get(); }
+            T& operator*() { return *get(); }
+        };
+    }
+}
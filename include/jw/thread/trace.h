@@ -0,0 +1,51 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
+
+#pragma once
+#include <cstdint>
+#include <iostream>
+#include <../jwdpmi_config.h>
+
+namespace jw
+{
+    namespace thread
+    {
+        enum class trace_event_type : std::uint32_t
+        {
+            switch_in,
+            switch_out,
+            start,
+            finish,
+            abort,
+            irq_enter,
+            irq_exit
+        };
+
+        // One entry in the scheduler trace. id is a thread id, or an interrupt vector for irq events.
+        struct trace_event
+        {
+            std::uint64_t tsc;
+            std::uint32_t id;
+            trace_event_type type;
+        };
+
+        // Writes the scheduler trace in Chrome trace event format, for chrome://tracing or ui.perfetto.dev.
+        // Timestamps are divided by tsc_per_us, so pass the TSC frequency in MHz to get real time.
+        // Requires config::enable_scheduler_trace.
+        void dump_trace_json(std::ostream& out, double tsc_per_us = 1);
+
+        // Writes the scheduler trace as a 32-bit event count, followed by that many trace_events, oldest first.
+        void dump_trace_binary(std::ostream& out);
+
+        namespace detail
+        {
+            void trace_record(trace_event_type type, std::uint32_t id) noexcept;
+
+            // Adds an event to the trace buffer. Compiles to nothing if tracing is disabled.
+            inline void trace(trace_event_type type, std::uint32_t id) noexcept
+            {
+                if constexpr (config::enable_scheduler_trace) trace_record(type, id);
+            }
+        }
+    }
+}
@@ -19,15 +19,57 @@ namespace jw
         // Total memory allocated to store fpu contexts.
         constexpr std::size_t interrupt_fpu_context_pool = 32_KB;
 
+        // Memory allocated for the stack of fpu context pointers, which grows by one entry for each nested interrupt.
+        constexpr std::size_t interrupt_fpu_context_stack_size = 8_KB;
+
         // Initial memory pool for operator new() in interrupt context.
         constexpr std::size_t interrupt_initial_memory_pool = 1_MB;
 
+        // Size of the bump-pointer arena for operator new() in interrupt context. Each nested interrupt allocates
+        // on top of the previous one, and everything it allocated is released at once when it returns, so memory
+        // allocated in an IRQ handler must not outlive it. When the arena is full, the memory pool above is used.
+        // Set to 0 to disable.
+        constexpr std::size_t interrupt_arena_size = 0;
+
+        // Use a size-class heap for operator new() outside interrupt context, instead of the djgpp malloc().
+        // Allocations larger than 4KB still use malloc().
+        constexpr bool enable_builtin_heap = false;
+
+        // Size of each memory block allocated for the heap above. Blocks are locked and never returned.
+        constexpr std::size_t builtin_heap_block_size = 1_MB;
+
+        // Size of the conventional memory pool for real-mode transfer buffers (dpmi::dos_buffer).
+        constexpr std::size_t dos_transfer_pool_size = 16_KB;
+
         // Total stack size for exception handlers. Remote debugging requires a lot of stack space.
         constexpr std::size_t exception_stack_size = 1_MB;
 
         // Default stack size for threads.
         constexpr std::size_t thread_default_stack_size = 64_KB;
 
+        // Number of thread_local_ptr slots. Each thread reserves this many pointers at the top of its stack.
+        constexpr std::size_t thread_local_slots = 32;
+
+        // Maximum amount of memory kept in the pool of unused thread stacks. Stacks are taken from this pool when a
+        // task is started, and returned when it finishes. Anything beyond this amount is freed.
+        constexpr std::size_t thread_stack_pool_size = 256_KB;
+
+        // Allocate thread stacks with an uncommitted guard page below them, so that a stack overflow throws
+        // thread::stack_overflow immediately. Requires DPMI 1.0 memory functions (0x0504, 0x0507). If these are not
+        // supported, stack overflows are only detected on the next thread switch.
+        constexpr bool thread_stack_guard_page = true;
+
+        // Count the TSC cycles each thread spends running, and the time spent in interrupt handlers. See
+        // thread::get_cpu_usage(). Adds two RDTSC instructions to each thread switch and each interrupt, and requires
+        // a Pentium or later.
+        constexpr bool enable_thread_cpu_time = false;
+
+        // Number of entries in the deferred procedure call queue, see thread::queue_dpc(). Must be a power of two.
+        constexpr std::size_t dpc_queue_size = 64;
+
+        // Size of the locked memory pool for co_task coroutine frames.
+        constexpr std::size_t coroutine_frame_pool_size = 64_KB;
+
         // Set up cpu exception handlers to throw C++ exceptions instead.
         constexpr bool enable_throwing_from_cpu_exceptions = true;
 
@@ -37,6 +79,17 @@ namespace jw
         // Enable debug messages from the gdb interface
         constexpr bool enable_gdb_debug_messages = false;
 
+        // Collect usage statistics for locked memory allocators. See dpmi::print_allocator_statistics(), or use
+        // the "monitor alloc" command in gdb.
+        constexpr bool enable_allocator_statistics = false;
+
+        // Record thread switches, task start/finish/abort and interrupts in a ring buffer, with TSC timestamps.
+        // See thread::dump_trace_json(). When disabled, this has no overhead at all.
+        constexpr bool enable_scheduler_trace = false;
+
+        // Number of events kept in the trace buffer. Must be a power of two.
+        constexpr std::size_t scheduler_trace_size = 4096;
+
         // Enable this to work around buggy keyboard code in dosbox.
         constexpr bool dosbox = false;
     }
@@ -1,7 +1,8 @@
 /* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
 /* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
-/* Copyright (C) 2016 J.W. Jagersma, see COPYING.txt for details */
 
+#include <iostream>
+#include <iomanip>
 #include <jw/dpmi/alloc.h>
 
 namespace jw
@@ -10,9 +11,43 @@ namespace jw
     {
         namespace detail
         {
-            std::map<void*, data_lock>* locking_allocator_base::map { nullptr };
+            allocator_statistics_node* allocator_statistics_node::list { nullptr };
+
+            // Constructed on first use, since locking_allocator may be used during static initialization.
+            allocator_statistics_node& locking_allocator_statistics()
+            {
+                static auto* node = new allocator_statistics_node { "locking_allocator" };
+                return *node;
+            }
+        }
+
+        std::ostream& operator<<(std::ostream& out, const allocator_statistics& s)
+        {
+            out << std::dec;
+            out << "in use: " << s.bytes_in_use << " bytes, peak: " << s.peak_bytes_in_use << " bytes";
+            if (s.largest_free_chunk > 0) out << ", largest free chunk: " << s.largest_free_chunk << " bytes";
+            out << '\n' << "allocations: " << s.allocations << ", failed: " << s.failed_allocations << '\n';
+            out << "sizes:";
+            for (std::size_t i = 0; i < s.size_histogram.size(); ++i)
+            {
+                if (s.size_histogram[i] == 0) continue;
+                out << ' ';
+                if (i == s.size_histogram.size() - 1) out << '>' << (16ul << (i - 1));
+                else out << "<=" << (16ul << i);
+                out << ": " << s.size_histogram[i];
+            }
+            return out << '\n';
         }
 
-        std::map<void*, locking_memory_resource::ptr_with_lock>* locking_memory_resource::map;
+        void print_allocator_statistics(std::ostream& out)
+        {
+            if (!config::enable_allocator_statistics)
+            {
+                out << "Allocator statistics are disabled.\n";
+                return;
+            }
+            for (auto* i = detail::allocator_statistics_node::list; i != nullptr; i = i->next)
+                out << i->name << ":\n" << i->get_statistics() << '\n';
+        }
     }
 }
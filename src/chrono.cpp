@@ -73,6 +73,7 @@ namespace jw
             ++pit_ticks;
 
             if (current_tsc_ref() == tsc_reference::pit) update_tsc();
+            thread::detail::scheduler::timer_tick();
 
             ack();
         }, dpmi::always_call | dpmi::no_auto_eoi };
@@ -88,6 +89,7 @@ namespace jw
             ns_per_pit_tick = 1e9 / (max_pit_frequency / freq_divider);
             pit_irq.set_irq(0);
             pit_irq.enable();
+            thread::detail::scheduler::set_timer(ns_per_pit_tick);
 
             split_uint16_t div { freq_divider };
             pit_cmd.write(0x34);
@@ -137,6 +139,7 @@ namespace jw
             dpmi::interrupt_mask no_irq { };
             if (current_tsc_ref() == tsc_reference::pit) reset_tsc();
             pit_irq.disable();
+            thread::detail::scheduler::set_timer(0);
             pit_ticks = 0;
             pit_cmd.write(0x34);
             pit0_data.write(0);
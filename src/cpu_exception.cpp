@@ -4,6 +4,7 @@
 
 #include <jw/dpmi/cpu_exception.h>
 #include <jw/dpmi/debug.h>
+#include <jw/thread/thread.h>
 #include <cstring>
 
 namespace jw
@@ -219,6 +220,13 @@ namespace jw
                 throw cpu_exception(n, create_exception_message());
             }
 
+            [[noreturn, gnu::used, gnu::optimize("no-omit-frame-pointer")]] 
+            void throw_stack_overflow(std::uint32_t) 
+            {
+                throwing_exception = false;
+                throw thread::stack_overflow { };
+            }
+
             bool simulate_call(std::uint32_t exc, cpu_registers *reg, exception_frame* frame, bool new_type, auto* func) noexcept
             {
                 if (frame->fault_address.segment != get_cs()) return false;     // Only throw if exception happened in our code
@@ -264,7 +272,13 @@ namespace jw
                 exception_throwers[0x0b] = std::make_unique<exception_handler>(0x0b, [](cpu_registers* r, exception_frame* f, bool t) { return simulate_call(0x0b, r, f, t, throw_cpu_exception); });
                 exception_throwers[0x0c] = std::make_unique<exception_handler>(0x0c, [](cpu_registers* r, exception_frame* f, bool t) { return simulate_call(0x0c, r, f, t, throw_cpu_exception); });
                 exception_throwers[0x0d] = std::make_unique<exception_handler>(0x0d, [](cpu_registers* r, exception_frame* f, bool t) { return simulate_call(0x0d, r, f, t, throw_cpu_exception); });
-                exception_throwers[0x0e] = std::make_unique<exception_handler>(0x0e, [](cpu_registers* r, exception_frame* f, bool t) { return simulate_call(0x0e, r, f, t, throw_cpu_exception); });
+                exception_throwers[0x0e] = std::make_unique<exception_handler>(0x0e, [](cpu_registers* r, exception_frame* f, bool t)
+                {
+                    // The guard page is committed again here, so the exception can be thrown on the overflowed stack.
+                    if (t && thread::detail::scheduler::handle_guard_page_fault(static_cast<new_exception_frame*>(f)->linear_page_fault_address))
+                        return simulate_call(0x0e, r, f, t, throw_stack_overflow);
+                    return simulate_call(0x0e, r, f, t, throw_cpu_exception); 
+                });
 
                 capabilities c { };
                 if (!c.supported) return;
@@ -0,0 +1,83 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
+
+#include <algorithm>
+#include <iomanip>
+#include <jw/thread/cpu_usage.h>
+#include <jw/thread/detail/scheduler.h>
+#include <jw/chrono/chrono.h>
+
+namespace jw
+{
+    namespace thread
+    {
+        namespace
+        {
+            void sort_by_usage(std::vector<thread_cpu_usage>& v)
+            {
+                std::stable_sort(v.begin(), v.end(), [](const auto& a, const auto& b) { return a.cycles > b.cycles; });
+            }
+        }
+
+        cpu_usage get_cpu_usage()
+        {
+            using namespace detail;
+            dpmi::throw_if_irq();
+            cpu_usage u { };
+            std::size_t n { 1 };
+            scheduler::for_each_thread([&n](const auto&) { ++n; });
+            u.threads.reserve(n + 8);
+
+            dpmi::interrupt_mask no_interrupts_please { };
+            auto add = [&u](const thread* t) { u.threads.push_back({ t->id(), t->name, t->get_priority(), t->get_state(), t->cpu_cycles() }); };
+            scheduler::for_each_thread([&add](const thread_ptr& t) { add(t.get()); });
+            add(scheduler::current_thread);
+            if constexpr (config::enable_thread_cpu_time)
+            {
+                u.idle_cycles = scheduler::idle_cycles;
+                if (scheduler::idling) u.idle_cycles += scheduler::running_cycles();
+                u.irq_cycles = dpmi::detail::interrupt_cycles;
+                u.total_cycles = chrono::rdtsc() - scheduler::start_tsc;
+            }
+            sort_by_usage(u.threads);
+            return u;
+        }
+
+        cpu_usage cpu_usage::since(const cpu_usage& earlier) const
+        {
+            cpu_usage u { *this };
+            u.total_cycles -= earlier.total_cycles;
+            u.idle_cycles -= earlier.idle_cycles;
+            u.irq_cycles -= earlier.irq_cycles;
+            for (auto& t : u.threads)
+            {
+                auto i = std::find_if(earlier.threads.begin(), earlier.threads.end(), [&t](const auto& e) { return e.id == t.id; });
+                if (i != earlier.threads.end() && i->cycles <= t.cycles) t.cycles -= i->cycles;
+            }
+            sort_by_usage(u.threads);
+            return u;
+        }
+
+        std::ostream& operator<<(std::ostream& out, const cpu_usage& u)
+        {
+            static const char* state_names[] { "initialized", "starting", "running", "suspended", "terminating", "finished" };
+            auto flags = out.flags();
+            auto precision = out.precision();
+            auto percent = [&u](std::uint64_t n) { return u.total_cycles == 0 ? 0.0 : 100.0 * n / u.total_cycles; };
+            auto line = [&](auto id, auto pri, const char* state, std::uint64_t cycles, const std::string& name)
+            {
+                out << std::setw(5) << id << std::setw(4) << pri << ' ' << std::left << std::setw(12) << state << std::right;
+                out << std::setw(7) << percent(cycles) << std::setw(16) << cycles << "  " << name << '\n';
+            };
+
+            out << std::fixed << std::setprecision(1);
+            out << "   ID PRI STATE          CPU%          CYCLES  NAME\n";
+            for (auto& t : u.threads) line(t.id, t.priority, state_names[t.state], t.cycles, t.name);
+            line('-', '-', "", u.irq_cycles, "(interrupts)");
+            line('-', '-', "", u.idle_cycles, "(idle)");
+            out.flags(flags);
+            out.precision(precision);
+            return out;
+        }
+    }
+}
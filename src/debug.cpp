@@ -7,6 +7,7 @@
 #include <iomanip>
 #include <memory>
 #include <jw/dpmi/fpu.h>
+#include <jw/dpmi/alloc.h>
 #include <jw/dpmi/dpmi.h>
 #include <jw/dpmi/debug.h>
 #include <jw/dpmi/cpu_exception.h>
@@ -27,7 +28,7 @@ namespace jw
 
             bool debug_mode { false };
 
-            locked_pool_allocator<> alloc { 1_MB };
+            locked_pool_allocator<> alloc { 1_MB, "gdb interface" };
             std::deque<std::string, locked_pool_allocator<>> sent { alloc };
             std::map<std::string, std::string, std::less<std::string>, locked_pool_allocator<>> supported { alloc };
             std::map<std::uintptr_t, watchpoint, std::less<std::uintptr_t>, locked_pool_allocator<>> watchpoints { alloc };
@@ -143,10 +144,10 @@ namespace jw
                     if (!i->second.thread.lock()) i = threads.erase(i);
                     else ++i;
                 }
-                for (auto& t : jw::thread::detail::scheduler::get_threads())
+                jw::thread::detail::scheduler::for_each_thread([](const auto& t)
                 {
                     threads[t->id()].thread = t;
-                }
+                });
                 current_thread_id = jw::thread::detail::scheduler::get_current_thread_id();
                 threads[current_thread_id].thread = jw::thread::detail::scheduler::get_current_thread();
                 current_thread = &threads[current_thread_id];
@@ -547,6 +548,17 @@ namespace jw
                             encode(s, str.c_str(), str.size());
                             send_packet(s.str());
                         }
+                        else if (q == "Rcmd")   // monitor command
+                        {
+                            std::string cmd(packet.size() > 1 ? packet[1].size() / 2 : 0, '\0');
+                            if (cmd.size() > 0) reverse_decode(packet[1], &cmd[0], cmd.size());
+                            std::stringstream msg { };
+                            if (cmd == "alloc") print_allocator_statistics(msg);
+                            else msg << "Unknown command: " << cmd << '\n';
+                            auto str = msg.str();
+                            encode(s, str.c_str(), str.size());
+                            send_packet(s.str());
+                        }
                         else send_packet("");
                     }
                     else if (p == 'v')
@@ -96,6 +96,7 @@ namespace jw
             #endif
                     "add esp, 4;");
                 default_irq_context.save();
+                alloc.reserve(config::interrupt_fpu_context_pool / sizeof(fpu_context));
                 contexts.emplace_back(nullptr);
 
                 set_fpu_emulation(false, true);
@@ -106,7 +107,7 @@ namespace jw
                     exc06_handler = std::make_unique<exception_handler>(exception_num::invalid_opcode, [this](cpu_registers*, exception_frame*, bool) INTERRUPT
                     {
                         if (!get_fpu_emulation().em) return false;
-                        set_fpu_emulation(false);
+                        set_switch_pending(false);
                         switch_context();
                         return true;
                     });
@@ -114,16 +115,7 @@ namespace jw
 
                 exc07_handler = std::make_unique<exception_handler>(exception_num::device_not_available, [this](cpu_registers*, exception_frame*, bool) INTERRUPT
                 {
-                    if (__builtin_expect(use_ts_bit, true))
-                    {
-                        cr0_t cr0 { };
-                        cr0.task_switched = false;
-                        cr0.set();
-                    }
-                    else
-                    {
-                        set_fpu_emulation(false);
-                    }
+                    set_switch_pending(false);
                     switch_context();
                     return true;
                 });
@@ -2,9 +2,14 @@
 /* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
 
 #include <algorithm>
+#include <optional>
 #include <jw/dpmi/irq.h>
 #include <jw/dpmi/fpu.h>
+#include <jw/dpmi/detail/alloc.h>
 #include <jw/alloc.h>
+#include <jw/chrono/chrono.h>
+#include <jw/thread/trace.h>
+#include <jw/thread/dpc.h>
 
 namespace jw
 {
@@ -13,6 +18,8 @@ namespace jw
         namespace detail
         {
             volatile std::uint32_t interrupt_count { 0 };
+            volatile std::uint64_t interrupt_cycles { 0 };
+            interrupt_arena* irq_arena { nullptr };
             constexpr io::io_port<byte> irq_controller::pic0_cmd;
             constexpr io::io_port<byte> irq_controller::pic1_cmd;
             irq_controller::irq_controller_data* irq_controller::data { nullptr };
@@ -20,13 +27,18 @@ namespace jw
             void irq_controller::interrupt_entry_point(int_vector vec) noexcept
             {
                 ++interrupt_count;
+                std::uint64_t entry_tsc { 0 };
+                if constexpr (config::enable_thread_cpu_time) if (interrupt_count == 1) entry_tsc = chrono::rdtsc();   // nested interrupts are counted by the outer one
+                auto* arena = irq_arena;
+                auto arena_mark = config::interrupt_arena_size > 0 && arena != nullptr ? arena->mark() : 0;
                 data->current_int.push_back(vec);
                 fpu_context_switcher.enter();
+                thread::detail::trace(thread::trace_event_type::irq_enter, vec);
                 
                 byte* esp; asm("mov %0, esp;":"=rm"(esp));
                 if (__builtin_expect(static_cast<std::size_t>(esp - data->stack.data()) <= config::interrupt_minimum_stack_size, false))
                 {
-                    data->increase_stack_size->start();
+                    if (!data->stack_resize_pending) data->stack_resize_pending = thread::queue_dpc([] { data->increase_stack_size(); });
                 }
 
                 auto i = vec_to_irq(vec);
@@ -34,9 +46,9 @@ namespace jw
 
                 try
                 {
-                    std::unique_ptr<irq_mask> mask;
+                    std::optional<irq_mask> mask;
                     if (!(data->entries.at(vec)->flags & no_interrupts)) asm("sti");
-                    else if (data->entries.at(vec)->flags & no_reentry) mask = std::make_unique<irq_mask>(i);
+                    else if (data->entries.at(vec)->flags & no_reentry) mask.emplace(i);
                     if (!(data->entries.at(vec)->flags & no_auto_eoi)) send_eoi();
                 
                     data->entries.at(vec)->call();
@@ -45,8 +57,11 @@ namespace jw
 
                 spurious:
                 asm("cli");
+                thread::detail::trace(thread::trace_event_type::irq_exit, vec);
                 acknowledge();
                 fpu_context_switcher.leave();
+                if (config::interrupt_arena_size > 0 && arena != nullptr) arena->release(arena_mark);
+                if constexpr (config::enable_thread_cpu_time) if (entry_tsc != 0) interrupt_cycles += chrono::rdtsc() - entry_tsc;
                 --interrupt_count;
                 data->current_int.pop_back();
             }
@@ -0,0 +1,90 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
+
+#include <memory>
+#include <jw/dpmi/lock.h>
+#include <jw/dpmi/irq_mask.h>
+
+namespace jw
+{
+    namespace dpmi
+    {
+        namespace detail
+        {
+            std::array<page_lock_table::table*, page_lock_table::directory_size> page_lock_table::directory { };
+
+            void page_lock_table::lock(const void* ptr, std::size_t num_bytes)
+            {
+                if (num_bytes == 0) return;
+                auto first = reinterpret_cast<std::uintptr_t>(ptr) >> page_shift;
+                auto last = (reinterpret_cast<std::uintptr_t>(ptr) + num_bytes - 1) >> page_shift;
+
+                for (auto i = first >> table_bits; i <= last >> table_bits; ++i)
+                    if (directory[i] == nullptr) directory[i] = new_table();
+
+                interrupt_mask no_interrupts_please { };
+                auto run = first;
+                auto i = first;
+                try
+                {
+                    for (; i <= last; ++i)
+                    {
+                        if (count(i)++ == 0) continue;
+                        if (run != i) lock_pages(run, i);
+                        run = i + 1;
+                    }
+                    if (run != i) lock_pages(run, i);
+                }
+                catch (...)
+                {
+                    // Pages [run, i] were counted but not locked by us.
+                    for (auto j = run; j <= std::min(i, last); ++j) --count(j);
+                    release(first, run);
+                    throw;
+                }
+            }
+
+            void page_lock_table::unlock(const void* ptr, std::size_t num_bytes) noexcept
+            {
+                if (num_bytes == 0) return;
+                auto first = reinterpret_cast<std::uintptr_t>(ptr) >> page_shift;
+                auto last = (reinterpret_cast<std::uintptr_t>(ptr) + num_bytes - 1) >> page_shift;
+
+                interrupt_mask no_interrupts_please { };
+                release(first, last + 1);
+            }
+
+            void page_lock_table::release(std::uintptr_t begin, std::uintptr_t end) noexcept
+            {
+                auto run = begin;
+                for (auto i = begin; i < end; ++i)
+                {
+                    if (--count(i) == 0) continue;
+                    if (run != i) unlock_pages(run, i);
+                    run = i + 1;
+                }
+                if (run != end) unlock_pages(run, end);
+            }
+
+            // Tables are walked by unlock() in interrupt context, so their memory is locked as well. They are never
+            // freed. This lock is not counted in the tables themselves.
+            page_lock_table::table* page_lock_table::new_table()
+            {
+                auto t = std::make_unique<table>();
+                linear_memory { get_ds(), t.get(), sizeof(table) }.lock_memory();
+                return t.release();
+            }
+
+            void page_lock_table::lock_pages(std::uintptr_t begin, std::uintptr_t end)
+            {
+                linear_memory { get_ds(), reinterpret_cast<const void*>(begin << page_shift), (end - begin) << page_shift }.lock_memory();
+            }
+
+            void page_lock_table::unlock_pages(std::uintptr_t begin, std::uintptr_t end) noexcept
+            {
+                try { linear_memory { get_ds(), reinterpret_cast<const void*>(begin << page_shift), (end - begin) << page_shift }.unlock_memory(); }
+                catch (...) { }
+            }
+        }
+    }
+}
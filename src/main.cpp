@@ -4,11 +4,14 @@
 #include <cstring>
 #include <string>
 #include <deque>
+#include <vector>
 #include <crt0.h>
 #include <jw/alloc.h>
 #include <jw/dpmi/debug.h>
 #include <jw/dpmi/cpu_exception.h>
 #include <jw/dpmi/detail/alloc.h>
+#include <jw/dpmi/detail/heap.h>
+#include <jw/dpmi/memory.h>
 #include <jw/io/rs232.h>
 #include <../jwdpmi_config.h>
 
@@ -120,9 +123,10 @@ int main(int argc, char** argv)
     catch (const jw::terminate_exception& e) { std::cerr << e.what() << '\n'; }
     catch (...) { std::cerr << "Caught unknown exception in main()!\n"; }
 
-    for (auto& t : thread::detail::scheduler::threads) t->abort();
-    auto thread_queue_copy = thread::detail::scheduler::threads;
-    for (auto& t : thread_queue_copy)
+    std::vector<thread::detail::thread_ptr> threads;
+    thread::detail::scheduler::for_each_thread([&threads](const auto& t) { threads.push_back(t); });
+    for (auto& t : threads) t->abort();
+    for (auto& t : threads)
     {
         while (t->is_running() || t->pending_exceptions() > 0)
         {
@@ -148,13 +152,50 @@ namespace jw
         yes
     } new_alloc_initialized { no };
     dpmi::detail::new_allocator* new_alloc { nullptr };
-    std::atomic_flag new_alloc_resize_reentry { false };
+
+    struct heap_block_source
+    {
+        // Obtains locked memory from DPMI. The memory_base objects are deliberately leaked, and are themselves
+        // allocated with malloc() to avoid recursing into operator new().
+        static void* allocate(std::size_t n)
+        {
+            using heap = dpmi::detail::basic_heap<heap_block_source>;
+            void* m = std::malloc(sizeof(dpmi::memory<byte>));
+            if (m == nullptr) throw std::bad_alloc { };
+            dpmi::memory<byte>* block;
+            try
+            {
+                block = new(m) dpmi::memory<byte> { n + heap::span_size };
+                block->lock_memory();
+            }
+            catch (...)
+            {
+                std::free(m);
+                std::throw_with_nested(std::bad_alloc { });
+            }
+            auto p = reinterpret_cast<std::uintptr_t>(block->get_ptr());
+            return reinterpret_cast<void*>((p + heap::span_size - 1) & -heap::span_size);
+        }
+    };
+
+    // A template, so that the heap and its span map are only instantiated when enabled.
+    template<typename heap_type = dpmi::detail::basic_heap<heap_block_source>>
+    heap_type& builtin_heap() noexcept
+    {
+        static heap_type heap { config::builtin_heap_block_size };
+        return heap;
+    }
 }
 
 void* operator new(std::size_t n)
 {
     if (dpmi::in_irq_context())
     {
+        if (config::interrupt_arena_size > 0 && dpmi::detail::interrupt_count > 0 && dpmi::detail::irq_arena != nullptr)
+        {
+            auto* p = dpmi::detail::irq_arena->allocate(n);
+            if (p != nullptr) return p;
+        }
         if (new_alloc_initialized == yes) return new_alloc->allocate(n);
         else throw std::bad_alloc { };
     }
@@ -169,6 +210,8 @@ void* operator new(std::size_t n)
                 if (new_alloc != nullptr) delete new_alloc;
                 new_alloc = nullptr;
                 new_alloc = new dpmi::detail::new_allocator { };
+                if (config::interrupt_arena_size > 0 && dpmi::detail::irq_arena == nullptr)
+                    dpmi::detail::irq_arena = new dpmi::detail::interrupt_arena { config::interrupt_arena_size };
                 new_alloc_initialized = yes;
             }
         }
@@ -178,35 +221,32 @@ void* operator new(std::size_t n)
             throw;
         }
     }
-    else if (new_alloc_initialized == yes && !new_alloc_resize_reentry.test_and_set())
+
+    if constexpr (config::enable_builtin_heap)
     {
-        dpmi::interrupt_mask no_interrupts_here { };
-        dpmi::trap_mask dont_trap_here { };
-        try
-        {
-            new_alloc_initialized = almost;
-            jw::new_alloc->resize_if_necessary();
-            new_alloc_initialized = yes;
-        }
-        catch (...)
-        {
-            new_alloc_initialized = no;
-            new_alloc_resize_reentry.clear();
-            throw;
-        }
-        new_alloc_resize_reentry.clear();
+        auto& heap = builtin_heap();
+        if (n <= heap.max_size) return heap.allocate(n);
     }
-    
     return std::malloc(n);
 }
 
 void operator delete(void* p, std::size_t)
 {
+    if (config::interrupt_arena_size > 0 && dpmi::detail::irq_arena != nullptr && dpmi::detail::irq_arena->in_arena(p)) return;
     if (new_alloc_initialized == yes && new_alloc->in_pool(p))
     {
         new_alloc->deallocate(p);
         return;
     }
+    if constexpr (config::enable_builtin_heap)
+    {
+        auto& heap = builtin_heap();
+        if (heap.owns(p))
+        {
+            heap.deallocate(p);
+            return;
+        }
+    }
     std::free(p);
 }
 
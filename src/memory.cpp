@@ -15,7 +15,11 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <bitset>
 #include <jw/dpmi/memory.h>
+#include <jw/dpmi/irq_mask.h>
+#include <jw/dpmi/irq_check.h>
+#include <../jwdpmi_config.h>
 
 namespace jw
 {
@@ -136,6 +140,33 @@ namespace jw
             addr = new_addr;
         }
 
+        void memory_base::commit(std::size_t offset, std::size_t num_bytes, bool committed)
+        {
+            auto first = round_down_to_page_size(offset);
+            auto pages = (round_up_to_page_size(offset + num_bytes) - first) / get_page_size();
+            std::uint16_t attr = committed ? 0b1001 : 0b0000;   // committed read/write, or uncommitted
+            dpmi_error_code error;
+            bool c;
+            for (std::size_t i = 0; i < pages; ++i)
+            {
+                asm volatile(
+                    "push es;"
+                    "mov es, %w2;"
+                    "int 0x31;"
+                    "pop es;"
+                    : "=@ccc" (c)
+                    , "=a" (error)
+                    : "r" (get_ds())
+                    , "a" (0x0507)
+                    , "b" (first + i * get_page_size())
+                    , "c" (1)
+                    , "d" (&attr)
+                    , "S" (handle)
+                    : "memory");
+                if (c) throw dpmi_error(error, __PRETTY_FUNCTION__);
+            }
+        }
+
         void device_memory_base::old_alloc(std::uintptr_t physical_address)
         {
             throw_if_irq();
@@ -273,5 +304,53 @@ namespace jw
             if (c) throw dpmi_error(error, __PRETTY_FUNCTION__);
             size = num_bytes;
         }
+
+        namespace detail
+        {
+            namespace
+            {
+                constexpr std::size_t transfer_pool_paragraphs { bytes_to_paragraphs(config::dos_transfer_pool_size) };
+                std::unique_ptr<dos_memory<byte>> transfer_pool;
+                std::bitset<transfer_pool_paragraphs> transfer_pool_used;
+            }
+
+            std::ptrdiff_t dos_transfer_pool::allocate(std::size_t n)
+            {
+                if (__builtin_expect(!transfer_pool, false))
+                {
+                    if (in_irq_context() || transfer_pool_paragraphs == 0) return -1;
+                    transfer_pool = std::make_unique<dos_memory<byte>>(paragraphs_to_bytes(transfer_pool_paragraphs));
+                }
+
+                interrupt_mask no_interrupts_please { };
+                std::size_t run { 0 };
+                for (std::size_t i = 0; i < transfer_pool_paragraphs; ++i)
+                {
+                    if (transfer_pool_used[i]) { run = 0; continue; }
+                    if (++run < n) continue;
+                    auto first = i + 1 - n;
+                    for (auto j = first; j <= i; ++j) transfer_pool_used[j] = true;
+                    return first;
+                }
+                return -1;
+            }
+
+            void dos_transfer_pool::deallocate(std::ptrdiff_t first, std::size_t n) noexcept
+            {
+                interrupt_mask no_interrupts_please { };
+                for (std::size_t i = 0; i < n; ++i) transfer_pool_used[first + i] = false;
+            }
+
+            byte* dos_transfer_pool::get_ptr(std::ptrdiff_t first) noexcept
+            {
+                return transfer_pool->get_ptr() + paragraphs_to_bytes(first);
+            }
+
+            far_ptr16 dos_transfer_pool::get_dos_ptr(std::ptrdiff_t first) noexcept
+            {
+                auto p = transfer_pool->get_dos_ptr();
+                return far_ptr16 { static_cast<selector>(p.segment + first), p.offset };
+            }
+        }
     }
 }
@@ -22,8 +22,12 @@ namespace jw
 
         std::deque<detail::scancode> ps2_interface::get_scancodes()
         {
-            dpmi::irq_mask disable_irq { 1 };
-            return detail::scancode::extract(scancode_queue, get_scancode_set());
+            for (auto r = scancode_queue.peek(); !r.empty(); r = scancode_queue.peek())
+            {
+                pending_scancodes.insert(pending_scancodes.end(), r.begin(), r.end());
+                scancode_queue.pop(r.size());
+            }
+            return detail::scancode::extract(pending_scancodes, get_scancode_set());
         }
 
         void ps2_interface::reset()
@@ -40,8 +40,10 @@ namespace jw
                 uart_irq_enable_reg irqen { };
                 irq_enable.write(irqen);
 
-                setg(rx_buf.begin(), rx_buf.begin(), rx_buf.begin());
-                setp(tx_buf.begin(), tx_buf.end());
+                auto r = rx_buf.peek();
+                setg(r.begin(), r.begin(), r.end());
+                auto w = tx_buf.write_range();
+                setp(w.begin(), w.end());
 
                 uart_line_control_reg lctrl { };
                 lctrl.divisor_access = true;
@@ -94,61 +96,78 @@ namespace jw
 
             int rs232_streambuf::sync()
             {
-                while (tx_ptr < pptr())
+                overflow();
+                while (!tx_buf.empty())
                 {
-                    overflow();
-                    underflow();
+                    {
+                        irq_disable no_irq { this };
+                        put();
+                        get();
+                    }
                     thread::yield();
                 }
                 return 0;
             }
 
+            std::streamsize rs232_streambuf::showmanyc()
+            {
+                return rx_buf.size() - (gptr() - eback());
+            }
+
             std::streamsize rs232_streambuf::xsgetn(char_type * s, std::streamsize n)
             {
-                irq_disable no_irq { this };
-                std::streamsize max_n = 0;
-                while (max_n < n && underflow() != traits_type::eof()) max_n = std::min(rx_ptr - gptr(), n);
-                std::copy_n(gptr(), max_n, s);
-                setg(rx_buf.begin(), gptr() + max_n, rx_ptr);
-                return max_n;
+                std::streamsize done = 0;
+                while (done < n && underflow() != traits_type::eof())
+                {
+                    auto k = std::min(egptr() - gptr(), n - done);
+                    std::copy_n(gptr(), k, s + done);
+                    gbump(k);
+                    done += k;
+                }
+                return done;
             }
 
             rs232_streambuf::int_type rs232_streambuf::underflow()
             {
+                if (gptr() != egptr()) return traits_type::to_int_type(*gptr());
                 irq_disable no_irq { this };
-                if (gptr() != rx_buf.begin()) std::copy(gptr(), rx_ptr, rx_buf.begin());
-                rx_ptr = rx_buf.begin() + (rx_ptr - gptr()); 
-                setg(rx_buf.begin(), rx_buf.begin(), rx_ptr);
-                do 
-                { 
-                    get(); 
+                rx_buf.pop(gptr() - eback());
+                while (rx_buf.empty())
+                {
+                    get();
                     thread::yield();
-                } while (rx_ptr == gptr());
+                }
+                auto r = rx_buf.peek();
+                setg(r.begin(), r.begin(), r.end());
                 set_rts();
-                return *gptr();
+                return traits_type::to_int_type(*gptr());
             }
 
             std::streamsize rs232_streambuf::xsputn(const char_type * s, std::streamsize n)
             {
-                irq_disable no_irq { this };
-                auto max_n = std::min(tx_buf.end() - pptr(), n);
-                if (max_n < n) overflow();
-                max_n = std::min(tx_buf.end() - pptr(), n);
-                std::copy_n(s, max_n, pptr());
-                setp(pptr() + max_n, tx_buf.end());
-                return max_n;
+                std::streamsize done = 0;
+                while (done < n)
+                {
+                    if (pptr() == epptr()) overflow();
+                    auto k = std::min(epptr() - pptr(), n - done);
+                    std::copy_n(s + done, k, pptr());
+                    pbump(k);
+                    done += k;
+                }
+                return done;
             }
 
+            // Publishes the put area to the transmitter, and starts a new one in the remaining free space.
             rs232_streambuf::int_type rs232_streambuf::overflow(int_type c) 
             {
                 irq_disable no_irq { this };
                 do
                 {
+                    tx_buf.commit(pptr() - pbase());
                     put();
-                    if (tx_ptr != tx_buf.begin()) std::copy(tx_ptr, pptr(), tx_buf.begin());
-                    setp(tx_buf.begin() + (pptr() - tx_ptr), tx_buf.end());
-                    tx_ptr = tx_buf.begin();
-                    thread::yield();
+                    auto w = tx_buf.write_range();
+                    setp(w.begin(), w.end());
+                    if (pptr() == epptr()) thread::yield();
                 } while (pptr() == epptr());
                 if (traits_type::not_eof(c)) sputc(c);
                 return ~traits_type::eof();
@@ -3,9 +3,18 @@
 /* Copyright (C) 2016 J.W. Jagersma, see COPYING.txt for details */
 
 #include <algorithm>
+#include <vector>
+#include <cerrno>
 #include <jw/dpmi/irq_mask.h>
+#include <jw/dpmi/alloc.h>
+#include <jw/dpmi/memory.h>
+#include <jw/dpmi/fpu.h>
+#include <jw/chrono/chrono.h>
 #include <jw/thread/detail/scheduler.h>
 #include <jw/thread/thread.h>
+#include <jw/thread/trace.h>
+#include <jw/thread/dpc.h>
+#include <jw/thread/thread_local.h>
 
 namespace jw
 {
@@ -16,20 +25,472 @@ namespace jw
             std::uint32_t thread::id_count { 0 };
 
             scheduler::init_main scheduler::initializer;
-            dpmi::locked_pool_allocator<> scheduler::alloc { 128_KB };
-            std::deque<thread_ptr, dpmi::locked_pool_allocator<>> scheduler::threads { alloc };
-            thread_ptr scheduler::current_thread;
+            std::array<thread_list, thread::max_priority + 1> scheduler::ready_list;
+            std::uint32_t scheduler::ready_mask { 0 };
+            thread_list scheduler::suspended_list;
+            thread_list scheduler::sleep_list;
+            thread_list scheduler::blocked_list;
+            thread_list scheduler::starting_list;
+            volatile std::uint64_t scheduler::ticks { 0 };
+            double scheduler::ns_per_tick { 0 };
+            thread* scheduler::current_thread;
             thread_ptr scheduler::main_thread;
+            thread_ptr scheduler::finished_thread;
+            dpc_queue_type* dpc_queue { nullptr };
+            bool running_dpcs { false };
+
+            constexpr std::size_t tls_bytes { config::thread_local_slots * sizeof(void*) };
+            std::array<void*, config::thread_local_slots> main_tls { };
+            std::array<void (*)(void*), config::thread_local_slots> tls_dtors { };
+            std::size_t tls_slot_count { 0 };
+            void** current_tls { main_tls.data() };
+
+            std::size_t allocate_tls_slot(void (*dtor)(void*))
+            {
+                if (tls_slot_count == config::thread_local_slots) throw std::length_error { "Out of thread-local storage slots." };
+                tls_dtors[tls_slot_count] = dtor;
+                return tls_slot_count++;
+            }
+            std::uint64_t scheduler::start_tsc { 0 };
+            std::uint64_t scheduler::last_switch_tsc { 0 };
+            std::uint64_t scheduler::last_interrupt_cycles { 0 };
+            std::uint64_t scheduler::idle_cycles { 0 };
+            bool scheduler::idling { false };
+
+            // Unused thread stacks, with one free list per power-of-two size class. While a stack is in the pool,
+            // its lowest bytes hold a free_stack entry.
+            struct free_stack
+            {
+                byte* next;
+                dpmi::memory_base* block;
+            };
+            std::array<byte*, 32> free_stacks { };
+            std::size_t free_stack_bytes { 0 };
+            bool stack_guard_supported { config::thread_stack_guard_page };
+
+            inline std::size_t stack_class(std::size_t n) noexcept { return 32 - __builtin_clz(std::max<std::size_t>(n, 4_KB) - 1); }
+
+            // Allocates a stack with an uncommitted guard page below it. Returns nullptr if the DPMI host can't do this.
+            dpmi::memory_base* allocate_guarded_stack(std::size_t size)
+            {
+                if (!stack_guard_supported) return nullptr;
+                auto page = dpmi::get_page_size();
+                auto* block = new dpmi::memory_base { size + page };
+                try
+                {
+                    block->commit(0, page, false);
+                    dpmi::linear_memory { block->get_address() + page, size }.lock_memory();
+                }
+                catch (const dpmi::dpmi_error&)
+                {
+                    delete block;
+                    stack_guard_supported = false;
+                    return nullptr;
+                }
+                return block;
+            }
+
+            void free_stack_memory(byte* p, std::size_t size, dpmi::memory_base* block) noexcept
+            {
+                if (block == nullptr) return dpmi::locking_allocator<byte> { }.deallocate(p, size);
+                try { dpmi::linear_memory { block->get_address() + dpmi::get_page_size(), size }.unlock_memory(); }
+                catch (...) { }
+                delete block;
+            }
 
             scheduler::init_main::init_main()
             {
-                main_thread = std::shared_ptr<thread> { new thread(0, nullptr) };
+                main_thread = std::shared_ptr<thread> { new thread(0) };
                 main_thread->state = running;
                 main_thread->parent = main_thread;
+                main_thread->self = main_thread;
                 main_thread->name = "Main thread";
-                current_thread = main_thread;
+                current_thread = main_thread.get();
+                main_thread->tls = main_tls.data();
+                dpc_queue = new dpc_queue_type { };
+                if constexpr (config::enable_thread_cpu_time) start_tsc = last_switch_tsc = chrono::rdtsc();
+            }
+
+            void thread::suspend() noexcept { if (state == running) scheduler::set_suspended(this, true); }
+            void thread::resume() noexcept { if (state == suspended) scheduler::set_suspended(this, false); }
+
+            void thread::abort(bool)
+            {
+                if (!is_running()) return;
+                trace(trace_event_type::abort, id());
+                state = terminating;
+                scheduler::wake(this);
+            }
+
+            std::uint64_t thread::cpu_cycles() const noexcept
+            {
+                dpmi::interrupt_mask no_interrupts_please { };
+                if (scheduler::is_current_thread(this) && !scheduler::idling) return cycles + scheduler::running_cycles();
+                return cycles;
+            }
+
+            std::chrono::nanoseconds thread::cpu_time() const noexcept
+            {
+                return std::chrono::nanoseconds { static_cast<std::int64_t>(cpu_cycles() * chrono::chrono::ns_per_tsc_tick()) };
+            }
+
+            void thread::set_priority(std::uint32_t p) noexcept
+            {
+                base_priority = std::min(p, max_priority);
+                scheduler::set_effective_priority(this, base_priority);
+            }
+
+            void scheduler::push_ready(thread* t, bool front) noexcept
+            {
+                auto& l = ready_list[t->priority];
+                if (front) l.push_front(t);
+                else l.push_back(t);
+                ready_mask |= 1 << t->priority;
+            }
+
+            // Takes the first thread from the highest non-empty priority level.
+            thread* scheduler::pop_ready() noexcept
+            {
+                auto level = 31 - __builtin_clz(ready_mask);
+                auto* t = ready_list[level].pop_front();
+                if (ready_list[level].empty()) ready_mask &= ~(1 << level);
+                return t;
+            }
+
+            // Removes a thread from whichever list it is in.
+            void scheduler::unlink(thread* t) noexcept
+            {
+                auto* l = t->list;
+                if (l == nullptr) return;
+                if (t->waiting != nullptr) t->waiting->erase(t);
+                bool ready = is_ready(t);
+                l->erase(t);
+                if (ready && l->empty()) ready_mask &= ~(1 << (l - ready_list.data()));
+            }
+
+            // Moves a suspended, sleeping or blocked thread back to the ready list.
+            void scheduler::wake(thread* t) noexcept
+            {
+                dpmi::interrupt_mask no_interrupts_please { };
+                if (t == current_thread) t->wake_tick = 0;      // it may be about to go to sleep
+                if (t->list == nullptr || is_ready(t) || t->list == &starting_list) return;
+                unlink(t);
+                push_ready(t);
+            }
+
+            void scheduler::sleep_ns(std::int64_t ns)
+            {
+                if (ns_per_tick == 0) return;
+                auto n = static_cast<std::int64_t>(ns / ns_per_tick) - 1;
+                if (n < 1) return;
+                {
+                    dpmi::interrupt_mask no_interrupts_please { };
+                    current_thread->wake_tick = ticks + n;
+                }
+                thread_switch();
+            }
+
+            // Sets the timer interval in nanoseconds, or 0 when the timer is disabled. Without a timer, nothing
+            // would ever wake up the sleeping threads, so they are all woken up here.
+            void scheduler::set_timer(double ns) noexcept
+            {
+                dpmi::interrupt_mask no_interrupts_please { };
+                ns_per_tick = ns;
+                if (ns != 0) return;
+                while (!sleep_list.empty()) unpark(sleep_list.pop_front());
+            }
+
+            // Puts a thread that was sleeping or blocked back in the ready list, or the suspended list.
+            void scheduler::unpark(thread* t) noexcept
+            {
+                if (t->state == suspended && !exception_pending(t)) suspended_list.push_back(t);
+                else push_ready(t);
+            }
+
+            // Moves any threads that are due from the sleep list to the ready list. Called in interrupt context.
+            void scheduler::timer_tick() noexcept
+            {
+                dpmi::interrupt_mask no_interrupts_please { };
+                auto now = ticks + 1;
+                ticks = now;
+                while (!sleep_list.empty() && sleep_list.front()->wake_tick <= now)
+                    unpark(sleep_list.pop_front());
+            }
+
+            // The current thread is linked in before switching away, so that a notify from an interrupt handler
+            // can't be missed in between.
+            void scheduler::block(wait_queue* q)
+            {
+                {
+                    dpmi::interrupt_mask no_interrupts_please { };
+                    if (__builtin_expect(q->missed, false))     // an interrupt notified us before we got here
+                    {
+                        q->missed = false;
+                        return;
+                    }
+                    q->push_back(current_thread);
+                    blocked_list.push_back(current_thread);
+                }
+                thread_switch();
+            }
+
+            // Takes a stack from the pool. Does not allocate, so this is safe in interrupt context.
+            bool scheduler::take_stack(thread* t) noexcept
+            {
+                dpmi::interrupt_mask no_interrupts_please { };
+                auto c = stack_class(t->stack_size);
+                auto* p = free_stacks[c];
+                if (p == nullptr) return false;
+                auto* f = reinterpret_cast<free_stack*>(p);
+                free_stacks[c] = f->next;
+                t->stack_block = f->block;
+                free_stack_bytes -= 1 << c;
+                t->stack_size = 1 << c;
+                t->stack_ptr = p;
+                return true;
+            }
+
+            void scheduler::allocate_stack(thread* t)
+            {
+                if (take_stack(t)) return;
+                auto size = std::size_t { 1 } << stack_class(t->stack_size);
+                t->stack_block = allocate_guarded_stack(size);
+                if (t->stack_block != nullptr) t->stack_ptr = t->stack_block->get_ptr<byte>() + dpmi::get_page_size();
+                else t->stack_ptr = dpmi::locking_allocator<byte> { }.allocate(size);
+                t->stack_size = size;
+            }
+
+            // Returns a stack to the pool, or frees it if the pool is full (see config::thread_stack_pool_size).
+            // A stack that overflowed into its guard page is always freed.
+            void scheduler::release_stack(thread* t) noexcept
+            {
+                auto c = stack_class(t->stack_size);
+                auto* p = t->stack_ptr;
+                auto* block = t->stack_block;
+                t->stack_ptr = nullptr;
+                t->stack_block = nullptr;
+                if (!t->stack_overflowed)
+                {
+                    dpmi::interrupt_mask no_interrupts_please { };
+                    if (free_stack_bytes + t->stack_size <= config::thread_stack_pool_size)
+                    {
+                        *reinterpret_cast<free_stack*>(p) = { free_stacks[c], block };
+                        free_stacks[c] = p;
+                        free_stack_bytes += t->stack_size;
+                        return;
+                    }
+                }
+                t->stack_overflowed = false;
+                free_stack_memory(p, t->stack_size, block);
+            }
+
+            // Called from the page fault handler. If the current thread ran into its guard page, that page is
+            // committed so there is enough stack left to throw stack_overflow.
+            bool scheduler::handle_guard_page_fault(std::uintptr_t linear_address) noexcept
+            {
+                auto* t = current_thread;
+                auto* block = t->stack_block;
+                if (block == nullptr || t->stack_overflowed) return false;
+                auto page = dpmi::get_page_size();
+                if (linear_address < block->get_address() || linear_address >= block->get_address() + page) return false;
+                try { block->commit(0, page, true); }
+                catch (...) { return false; }
+                t->stack_overflowed = true;
+                return true;
+            }
+
+            // Called after switching away from a finished thread, when its stack is no longer in use.
+            void scheduler::release_finished_thread() noexcept
+            {
+                if (__builtin_expect(finished_thread == nullptr, true)) return;
+                if (finished_thread->stack_ptr != nullptr) release_stack(finished_thread.get());
+                dpmi::detail::fpu_context_switcher.release_thread(&finished_thread->fpu_state);
+                finished_thread.reset();
+            }
+
+            // Allocates stacks for threads that were started in interrupt context. If that fails, the task is not
+            // started, and the exception is passed on to its parent.
+            void scheduler::allocate_pending_stacks()
+            {
+                while (true)
+                {
+                    thread* t;
+                    {
+                        dpmi::interrupt_mask no_interrupts_please { };
+                        if (starting_list.empty()) return;
+                        t = starting_list.pop_front();
+                    }
+                    try
+                    {
+                        allocate_stack(t);
+                        dpmi::interrupt_mask no_interrupts_please { };
+                        push_ready(t, true);
+                    }
+                    catch (...)
+                    {
+                        auto keep = std::move(t->self);
+                        t->state = initialized;
+                        deliver_exception(t->parent.get(), std::current_exception());
+                    }
+                }
+            }
+
+            void wait_queue::push_back(thread* t) noexcept
+            {
+                t->waiting = this;
+                t->wait_next = nullptr;
+                t->wait_prev = tail;
+                if (tail != nullptr) tail->wait_next = t;
+                else head = t;
+                tail = t;
+            }
+
+            void wait_queue::erase(thread* t) noexcept
+            {
+                if (t->wait_prev != nullptr) t->wait_prev->wait_next = t->wait_next;
+                else head = t->wait_next;
+                if (t->wait_next != nullptr) t->wait_next->wait_prev = t->wait_prev;
+                else tail = t->wait_prev;
+                t->waiting = nullptr;
+                t->wait_next = t->wait_prev = nullptr;
+            }
+
+            bool wait_queue::notify_one() noexcept
+            {
+                dpmi::interrupt_mask no_interrupts_please { };
+                auto* t = head;
+                if (t == nullptr)
+                {
+                    missed |= dpmi::in_irq_context();
+                    return false;
+                }
+                for (auto* i = t->wait_next; i != nullptr; i = i->wait_next)
+                    if (i->priority > t->priority) t = i;
+                scheduler::unlink(t);
+                scheduler::unpark(t);
+                return true;
+            }
+
+            void wait_queue::notify_all() noexcept
+            {
+                dpmi::interrupt_mask no_interrupts_please { };
+                if (head == nullptr) missed |= dpmi::in_irq_context();
+                while (head != nullptr)
+                {
+                    auto* t = head;
+                    scheduler::unlink(t);
+                    scheduler::unpark(t);
+                }
+            }
+
+            // Changes a thread's effective priority, and moves it to the right ready_list if needed.
+            void scheduler::set_effective_priority(thread* t, std::uint32_t p) noexcept
+            {
+                dpmi::interrupt_mask no_interrupts_please { };
+                bool ready = is_ready(t);
+                if (ready) unlink(t);
+                t->priority = p;
+                if (ready) push_ready(t);
+            }
+
+            void scheduler::acquire_lock(priority_lock* l) noexcept
+            {
+                dpmi::interrupt_mask no_interrupts_please { };
+                l->next_held = current_thread->held_locks;
+                current_thread->held_locks = l;
+            }
+
+            void scheduler::release_lock(priority_lock* l) noexcept
+            {
+                dpmi::interrupt_mask no_interrupts_please { };
+                auto* t = current_thread;
+                for (auto** i = &t->held_locks; *i != nullptr; i = &(*i)->next_held)
+                {
+                    if (*i != l) continue;
+                    *i = l->next_held;
+                    break;
+                }
+                l->next_held = nullptr;
+
+                auto p = t->base_priority;
+                for (auto* i = t->held_locks; i != nullptr; i = i->next_held)
+                    for (auto* w = i->waiters.head; w != nullptr; w = w->wait_next)
+                        p = std::max(p, w->priority);
+                set_effective_priority(t, p);
+            }
+
+            // Moves a thread between the ready and suspended lists.
+            void scheduler::set_suspended(thread* t, bool s) noexcept
+            {
+                dpmi::interrupt_mask no_interrupts_please { };
+                t->state = s ? suspended : running;
+                if (s && is_ready(t))
+                {
+                    unlink(t);
+                    suspended_list.push_back(t);
+                }
+                else if (!s && t->list == &suspended_list)
+                {
+                    suspended_list.erase(t);
+                    push_ready(t);
+                }
             }
 
+            // Adds an exception to a thread, and makes sure it gets to run so it can be rethrown.
+            void scheduler::deliver_exception(thread* t, std::exception_ptr e)
+            {
+                t->exceptions.push_back(e);
+                wake(t);
+            }
+
+            // Adds an unhandled exception to the current thread. If its parent is awaiting it, the parent is woken
+            // up as well, even if it is suspended, so it can rethrow the exception.
+            void scheduler::add_exception(std::exception_ptr e)
+            {
+                current_thread->exceptions.push_back(e);
+                auto* p = current_thread->parent.get();
+                if (p != nullptr && p->awaiting.get() == current_thread) wake(p);
+            }
+
+#ifdef __x86_64__
+            // Host build (x86-64 SysV). The context is saved, the next thread selected and its context restored in a
+            // single asm statement, since the compiler may address its locals relative to rsp, or keep them in the
+            // red zone below it.
+            // May only be called from thread_switch()!
+            void scheduler::context_switch() noexcept
+            {
+                auto* next = switch_context;
+                asm volatile
+                    ("lea rsp, [rsp-128];"              // skip the red zone
+                     "push rbp; push rbx; push r12; push r13; push r14; push r15;"
+                     "mov rdi, rsp;"
+                     "and rsp, -0x10;"
+                     "call rax;"                        // returns the new context in rax, and the entry point in rdx
+                     "mov rsp, rax;"
+                     "pop r15; pop r14; pop r13; pop r12; pop rbx; pop rbp;"
+                     "test rdx, rdx;"                   // if starting a new thread
+                     "jz 1f;"
+                     "and rsp, -0x10;"                  // align stack to 0x10 bytes
+                     "mov rbp, rsp;"
+                     "push rbp;"
+                     "jmp rdx;"                         // jump to run_thread()
+                     "1: lea rsp, [rsp+128];"
+                     : "+a" (next)
+                     :: "rcx", "rdx", "rsi", "rdi", "r8", "r9", "r10", "r11"
+                     , "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7"
+                     , "xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm14", "xmm15"
+                     , "cc", "memory");
+            }
+
+            // Saves the current thread's context, and returns the one to switch to.
+            // May only be called from context_switch()!
+            scheduler::next_context scheduler::switch_context(thread_context* current) noexcept
+            {
+                current_thread->context = current;
+                set_next_thread();
+                return { current_thread->context, current_thread->state == starting ? run_thread : nullptr };
+            }
+#else
             // Save the current task context, switch to a new task, and restore its context.
             // May only be called from thread_switch()!
             void scheduler::context_switch() noexcept
@@ -61,6 +522,7 @@ namespace jw
                      , "i" (run_thread)
                      : "esp", "cc", "memory");
             }
+#endif
 
             // Switches to the specified task, or the next task in queue if argument is nullptr.
             void scheduler::thread_switch(thread_ptr t)
@@ -68,20 +530,73 @@ namespace jw
                 dpmi::trap_mask dont_trace_here { };
                 if (__builtin_expect(t != nullptr, false))
                 {
+                    if (t->stack_ptr == nullptr)
+                    {
+                        if (dpmi::in_irq_context()) take_stack(t.get());
+                        else allocate_stack(t.get());
+                    }
                     dpmi::interrupt_mask no_interrupts_please { };
-                    threads.erase(remove_if(threads.begin(), threads.end(), [t](const auto& i) { return i == t; }), threads.end());
-                    threads.push_front(t);
+                    if (t.get() != current_thread)
+                    {
+                        unlink(t.get());
+                        t->self = t;
+                        if (__builtin_expect(t->stack_ptr == nullptr, false)) starting_list.push_back(t.get());
+                        else push_ready(t.get(), true);
+                    }
                 }
-                if (dpmi::in_irq_context()) return;
+                if (dpmi::in_irq_context() || running_dpcs) return;     // only switch to t later
+                if (__builtin_expect(!dpc_queue->empty(), false)) run_dpcs();
+                if (__builtin_expect(!starting_list.empty(), false)) allocate_pending_stacks();
+                dpmi::detail::fpu_context_switcher.prepare_switch(&current_thread->fpu_state);
                 context_switch();   // switch to a new task context
+                release_finished_thread();
                 check_exception();  // rethrow pending exception
             }
 
+            // Runs all queued deferred procedure calls, on the current thread's stack. Each DPC is removed from the
+            // queue before it is called. While DPCs run, thread_switch() never switches away from the current thread.
+            void scheduler::run_dpcs() noexcept
+            {
+                running_dpcs = true;
+                while (!dpc_queue->empty())
+                {
+                    auto d = dpc_queue->front();
+                    dpc_queue->pop();
+                    try { d.call(&d); }
+                    catch (...)
+                    {
+                        try
+                        {
+                            try { std::throw_with_nested(thread_exception { nullptr }); }
+                            catch (...) { deliver_exception(main_thread.get(), std::current_exception()); }
+                        }
+                        catch (...) { }     // out of memory, the exception is lost
+                    }
+                }
+                running_dpcs = false;
+            }
+
+            bool scheduler::in_dpc() noexcept { return running_dpcs; }
+
+            // Destroys the current thread's thread_local_ptr instances.
+            void scheduler::destroy_thread_locals() noexcept
+            {
+                for (std::size_t i = 0; i < tls_slot_count; ++i)
+                {
+                    auto* p = current_tls[i];
+                    if (p == nullptr) continue;
+                    current_tls[i] = nullptr;
+                    try { tls_dtors[i](p); }
+                    catch (...) { add_exception(std::current_exception()); }
+                }
+            }
+
             // The actual thread.
             // May only be jumped to from context_switch()!
             [[noreturn]]
             void scheduler::run_thread() noexcept
             {
+                release_finished_thread();
                 try
                 {
                     current_thread->state = running;
@@ -91,20 +606,24 @@ namespace jw
                 catch (const abort_thread&) { }
                 catch (const terminate_exception&) 
                 { 
-                    for (auto& t : threads) t->exceptions.push_back(std::current_exception());
+                    std::vector<thread*> all;
+                    for_each_thread([&all](const auto& t) { all.push_back(t.get()); });
+                    for (auto* t : all) deliver_exception(t, std::current_exception());
                 }
                 catch (...) 
                 { 
-                    current_thread->exceptions.push_back(std::current_exception()); 
+                    add_exception(std::current_exception()); 
                 }
 
+                destroy_thread_locals();
                 if (current_thread->state != finished) current_thread->state = initialized;
+                trace(trace_event_type::finish, current_thread->id());
 
                 while (true) try { yield(); }
                 catch (const abort_thread&) { }
                 catch (...) 
                 { 
-                    current_thread->exceptions.push_back(std::current_exception()); 
+                    add_exception(std::current_exception()); 
                 }
             }
 
@@ -117,7 +636,7 @@ namespace jw
                     auto exc = current_thread->awaiting->exceptions.front();
                     current_thread->awaiting->exceptions.pop_front();
                     try { std::rethrow_exception(exc); }
-                    catch (...) { std::throw_with_nested(thread_exception { current_thread }); }
+                    catch (...) { std::throw_with_nested(thread_exception { current_thread->self }); }
                 }
                 if (__builtin_expect(current_thread->pending_exceptions() > 0, false))
                 for (auto exc : current_thread->exceptions)
@@ -139,38 +658,83 @@ namespace jw
                     catch (...) { }
                 }
                 
-                if (__builtin_expect(current_thread != main_thread && *reinterpret_cast<std::uint32_t*>(current_thread->stack_ptr) != 0xDEADBEEF, false))
-                    throw std::runtime_error("Stack overflow!");
+                if (__builtin_expect(current_thread->stack_block == nullptr && current_thread != main_thread.get() && *reinterpret_cast<std::uint32_t*>(current_thread->stack_ptr) != 0xDEADBEEF, false))
+                    throw stack_overflow { };
 
                 if (__builtin_expect(current_thread->state == terminating, false)) throw abort_thread();
-                if (__builtin_expect(current_thread.unique() && !current_thread->allow_orphan && current_thread->is_running(), false)) throw orphaned_thread();
+                if (__builtin_expect(current_thread->self.unique() && !current_thread->allow_orphan && current_thread->is_running(), false)) throw orphaned_thread();
+            }
+
+            // Returns the cycles spent in the current thread since the last thread switch, minus interrupts.
+            // Interrupts must be disabled.
+            std::uint64_t scheduler::running_cycles() noexcept
+            {
+                if constexpr (!config::enable_thread_cpu_time) return 0;
+                return (chrono::rdtsc() - last_switch_tsc) - (dpmi::detail::interrupt_cycles - last_interrupt_cycles);
+            }
+
+            // Charges the cycles since the last thread switch to t, or to the idle counter.
+            void scheduler::account_cycles(thread* t) noexcept
+            {
+                auto tsc = chrono::rdtsc();
+                std::uint64_t irq = dpmi::detail::interrupt_cycles;
+                auto n = (tsc - last_switch_tsc) - (irq - last_interrupt_cycles);
+                if (idling) idle_cycles += n;
+                else t->cycles += n;
+                last_switch_tsc = tsc;
+                last_interrupt_cycles = irq;
             }
 
             // Selects a new current_thread.
             // May only be called from context_switch()!
-            void scheduler::set_next_thread() noexcept        // TODO: catch exceptions here (from deque, shared_ptr) and do something sensible
+            void scheduler::set_next_thread() noexcept
             {
                 dpmi::interrupt_mask no_interrupts_please { };
-                do
+                auto* t = current_thread;
+                if (__builtin_expect(t->list != nullptr, false)) { }  // blocked, or already woken by an interrupt
+                else if (__builtin_expect(t->is_running(), true))
                 {
-                    if (__builtin_expect(current_thread->is_running(), true)) threads.push_back(current_thread);
-
-                    current_thread = threads.front();
-                    threads.pop_front();
-
-                    if (__builtin_expect(current_thread->state == starting, false)) // new task, initialize new context on stack
+                    if (__builtin_expect(t->wake_tick > ticks, false))
                     {
-                        byte* esp = (current_thread->stack_ptr + current_thread->stack_size - 4) - sizeof(thread_context);
-                        *reinterpret_cast<std::uint32_t*>(current_thread->stack_ptr) = 0xDEADBEEF;  // stack overflow protection
-
-                        current_thread->context = reinterpret_cast<thread_context*>(esp);           // *context points to top of stack
-                        if (current_thread->parent == nullptr) current_thread->parent = main_thread;
-                        *current_thread->context = *current_thread->parent->context;                // clone parent's context to new stack
+                        auto* i = sleep_list.front();
+                        while (i != nullptr && i->wake_tick <= t->wake_tick) i = thread_list::next(i);
+                        sleep_list.insert(i, t);
                     }
+                    else if (__builtin_expect(t->state == suspended && !exception_pending(t), false)) suspended_list.push_back(t);
+                    else push_ready(t);
+                }
+                else finished_thread = std::move(t->self);  // may be the last reference, so release it after switching stacks
 
-                    if (__builtin_expect(current_thread->pending_exceptions() != 0, false)) break;
-                    if (__builtin_expect(current_thread->awaiting && current_thread->awaiting->pending_exceptions() != 0, false)) break;
-                } while (__builtin_expect(current_thread->state == suspended, false));
+                if constexpr (config::enable_thread_cpu_time) account_cycles(t);
+                t->saved_errno = errno;
+                idling = false;
+                if (__builtin_expect(ready_mask == 0, false))       // everything is suspended, wake up the main thread
+                {
+                    auto* m = main_thread.get();
+                    unlink(m);
+                    push_ready(m);
+                    idling = true;
+                }
+
+                current_thread = pop_ready();
+                current_thread->wake_tick = 0;
+                errno = current_thread->saved_errno;
+                trace(trace_event_type::switch_out, t->id());
+                trace(trace_event_type::switch_in, current_thread->id());
+                dpmi::detail::fpu_context_switcher.switch_thread(&t->fpu_state, &current_thread->fpu_state);
+                if (__builtin_expect(current_thread->state == starting, false)) // new task, initialize new context on stack
+                {
+                    byte* top = current_thread->stack_ptr + current_thread->stack_size - tls_bytes;
+                    current_thread->tls = reinterpret_cast<void**>(top);
+                    std::fill_n(current_thread->tls, config::thread_local_slots, nullptr);
+                    byte* esp = (top - sizeof(void*)) - sizeof(thread_context);
+                    *reinterpret_cast<std::uint32_t*>(current_thread->stack_ptr) = 0xDEADBEEF;  // stack overflow detection, if there is no guard page
+
+                    current_thread->context = reinterpret_cast<thread_context*>(esp);           // *context points to top of stack
+                    if (current_thread->parent == nullptr) current_thread->parent = main_thread;
+                    *current_thread->context = *current_thread->parent->context;                // clone parent's context to new stack
+                }
+                current_tls = current_thread->tls;
             }
         }
     }
@@ -0,0 +1,117 @@
+/* * * * * * * * * * * * * * libjwdpmi * * * * * * * * * * * * * */
+/* Copyright (C) 2017 J.W. Jagersma, see COPYING.txt for details */
+
+#include <atomic>
+#include <array>
+#include <vector>
+#include <jw/thread/trace.h>
+#include <jw/thread/thread.h>
+#include <jw/dpmi/lock.h>
+#include <jw/dpmi/irq_mask.h>
+#include <jw/chrono/chrono.h>
+
+namespace jw
+{
+    namespace thread
+    {
+        namespace detail
+        {
+            // Ring buffer of the most recent events. Written from interrupt context, so it must be locked.
+            struct trace_buffer : dpmi::class_lock<trace_buffer>
+            {
+                std::array<trace_event, config::scheduler_trace_size> events;
+                std::atomic<std::uint32_t> next { 0 };
+            };
+
+            static_assert((config::scheduler_trace_size & (config::scheduler_trace_size - 1)) == 0, "scheduler_trace_size must be a power of two.");
+
+            trace_buffer* trace_events { nullptr };
+            struct trace_init { trace_init() { if (config::enable_scheduler_trace) trace_events = new trace_buffer { }; } } trace_initializer;
+
+            void trace_record(trace_event_type type, std::uint32_t id) noexcept
+            {
+                auto* b = trace_events;
+                if (__builtin_expect(b == nullptr, false)) return;
+                auto tsc = chrono::rdtsc();
+                auto i = b->next++ & (b->events.size() - 1);
+                b->events[i] = { tsc, id, type };
+            }
+
+            // Copies the buffer, oldest event first.
+            std::vector<trace_event> trace_snapshot()
+            {
+                std::vector<trace_event> v;
+                if (trace_events == nullptr) return v;
+                v.reserve(trace_events->events.size());
+                dpmi::interrupt_mask no_interrupts_please { };
+                std::uint32_t end = trace_events->next;
+                std::uint32_t size = trace_events->events.size();
+                std::uint32_t begin = end > size ? end - size : 0;
+                for (auto i = begin; i != end; ++i) v.push_back(trace_events->events[i & (size - 1)]);
+                return v;
+            }
+        }
+
+        void dump_trace_binary(std::ostream& out)
+        {
+            auto v = detail::trace_snapshot();
+            std::uint32_t n = v.size();
+            out.write(reinterpret_cast<const char*>(&n), sizeof(n));
+            out.write(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(trace_event));
+        }
+
+        void dump_trace_json(std::ostream& out, double tsc_per_us)
+        {
+            auto v = detail::trace_snapshot();
+            auto escape = [](const std::string& s)
+            {
+                std::string r;
+                for (auto c : s)
+                {
+                    if (c == '"' || c == '\\') r += '\\';
+                    if (static_cast<unsigned char>(c) >= 0x20) r += c;
+                }
+                return r;
+            };
+
+            // Interrupts are shown on their own track, thread ids start at 1.
+            constexpr std::uint32_t irq_tid { 0 };
+            auto origin = v.empty() ? 0 : v.front().tsc;
+            auto flags = out.flags();
+            out << "{\"traceEvents\":[\n";
+            out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << irq_tid << ",\"args\":{\"name\":\"Interrupts\"}}";
+            auto name = [&](const detail::thread_ptr& t)
+            {
+                out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << t->id() << ",\"args\":{\"name\":\"" << escape(t->name) << "\"}}";
+            };
+            detail::scheduler::for_each_thread(name);
+            if (auto t = detail::scheduler::get_current_thread().lock()) name(t);
+
+            for (auto& e : v)
+            {
+                auto tid = e.id;
+                const char* ph;
+                const char* what;
+                switch (e.type)
+                {
+                case trace_event_type::switch_in:  ph = "B"; what = "running"; break;
+                case trace_event_type::switch_out: ph = "E"; what = "running"; break;
+                case trace_event_type::start:      ph = "i"; what = "start"; break;
+                case trace_event_type::finish:     ph = "i"; what = "finish"; break;
+                case trace_event_type::abort:      ph = "i"; what = "abort"; break;
+                case trace_event_type::irq_enter:  ph = "B"; what = "irq"; tid = irq_tid; break;
+                case trace_event_type::irq_exit:   ph = "E"; what = "irq"; tid = irq_tid; break;
+                default: continue;
+                }
+                out << ",\n{\"name\":\"" << what;
+                if (tid == irq_tid) out << " 0x" << std::hex << e.id << std::dec;
+                out << "\",\"ph\":\"" << ph << "\",\"pid\":0,\"tid\":" << tid;
+                out << ",\"ts\":" << std::fixed << (e.tsc - origin) / tsc_per_us;
+                if (*ph == 'i') out << ",\"s\":\"t\"";
+                out << '}';
+            }
+            out << "\n]}\n";
+            out.flags(flags);
+        }
+    }
+}
@@ -65,7 +65,7 @@ namespace jw
         void vbe::populate_mode_list(dpmi::far_ptr16 list_ptr)
         {
             dpmi::mapped_dos_memory<std::uint16_t> mode_list { 256, list_ptr };
-            dpmi::dos_memory<vbe_mode_info> mode_info { 1 };
+            dpmi::dos_buffer<vbe_mode_info> mode_info { 1 };
             auto get_mode = [&](std::uint16_t num)
             {
                 *mode_info = { };
@@ -100,7 +100,7 @@ namespace jw
         void vbe::init()
         {
             if (info.vbe_signature == "VESA") return;
-            dpmi::dos_memory<detail::raw_vbe_info> raw_info { 1 };
+            dpmi::dos_buffer<detail::raw_vbe_info> raw_info { 1 };
             auto* ptr = raw_info.get_ptr();
 
             dpmi::realmode_registers reg { };
@@ -125,7 +125,7 @@ namespace jw
         void vbe2::init()
         {
             if (info.vbe_signature == "VESA") return;
-            dpmi::dos_memory<detail::raw_vbe_info> raw_info { 1 };
+            dpmi::dos_buffer<detail::raw_vbe_info> raw_info { 1 };
             auto* ptr = raw_info.get_ptr();
             std::copy_n("VBE2", 4, ptr->vbe_signature);
 
@@ -325,7 +325,7 @@ namespace jw
             reg.bx = m.raw_value;
             if (m.use_custom_crtc_timings)
             {
-                dpmi::dos_memory<crtc_info> crtc_ptr { 1 };
+                dpmi::dos_buffer<crtc_info> crtc_ptr { 1 };
                 *crtc_ptr = *crtc;
                 reg.es = crtc_ptr.get_dos_ptr().segment;
                 reg.di = crtc_ptr.get_dos_ptr().offset;
@@ -622,7 +622,7 @@ namespace jw
             }
             else
             {
-                dpmi::dos_memory<px32n> dos_data { size };
+                dpmi::dos_buffer<px32n> dos_data { size };
                 if (dac_bits < 8)
                 {
                     for (std::size_t i = 0; i < size; ++i)
@@ -678,7 +678,7 @@ namespace jw
 
         std::vector<px32a> vbe2::get_palette()
         {
-            dpmi::dos_memory<px32a> dos_data { 256 };
+            dpmi::dos_buffer<px32a> dos_data { 256 };
 
             dpmi::realmode_registers reg { };
             reg.ax = 0x4f09;